@@ -3,6 +3,7 @@
 #include <float.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 
 #include "MQBasePlugin.h"
 #include "MQ3DLib.h"
@@ -11,12 +12,24 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <algorithm>
+#include <iterator>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define EXMOVE_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+// timings and counts of hot paths. dumped when the tool is deactivated
+//#define EXMOVE_PROFILE
 
 
 #define THRESHOLD_PICK_POINT 9.0f
 #define THRESHOLD_PICK_LINE 9.0f
+// how far the cursor can go before candidates for picking are gathered again
+#define PICK_WINDOW_MARGIN 12.0f
 
-void debuglog(MQDocument doc, const char* fmt, ...);
+static void debuglog(MQDocument doc, const char* fmt, ...);
 
 inline bool operator<(const MQSelectVertex& v1, const MQSelectVertex& v2) 
 {
@@ -27,6 +40,198 @@ inline bool operator<(const MQSelectVertex& v1, const MQSelectVertex& v2)
 
 static MQCommandPlugin::EDIT_OPTION s_editoption;
 
+#ifdef EXMOVE_PROFILE
+
+enum ProfileSection {
+	PROFILE_MOUSEMOVE,
+	PROFILE_PICK,
+	PROFILE_REFRESH_CACHE,
+	PROFILE_REFRESH_EDGE_CACHE,
+	PROFILE_GET_SELECTION,
+	PROFILE_DRAG,
+	PROFILE_REGIONAL_SELECT,
+	PROFILE_RENDER_VISIBILITY,
+	PROFILE_SOFT_SELECTION,
+	PROFILE_SECTION_COUNT
+};
+
+enum ProfileCounter {
+	PROFILE_VERTICES_PROJECTED,
+	PROFILE_VERTICES_TESTED,
+	PROFILE_FACES_TESTED,
+	PROFILE_COUNTER_COUNT
+};
+
+// latencies in microseconds on a log scale. 8 buckets for each power of 2, so percentiles are off by 12.5% at most
+class LatencyHistogram
+{
+public:
+	enum { BUCKETS = 1 + 8 * 32 };
+
+	LatencyHistogram() { Reset(); }
+
+	void Reset()
+	{
+		for(int b = 0; b < BUCKETS; b++) m_buckets[b] = 0;
+		m_count = 0;
+		m_sum = 0;
+		m_max = 0;
+	}
+
+	void Add(double us)
+	{
+		m_buckets[bucket(us)]++;
+		m_count++;
+		m_sum += us;
+		m_max = max(m_max,us);
+	}
+
+	unsigned int GetCount() const { return m_count; }
+	double GetMean() const { return m_count ? m_sum / m_count : 0; }
+	double GetMax() const { return m_max; }
+
+	// upper bound of the bucket the q-th one falls in
+	double GetPercentile(double q) const
+	{
+		if(m_count == 0) return 0;
+		unsigned int target = (unsigned int)ceil(q * m_count);
+		if(target == 0) target = 1;
+		unsigned int seen = 0;
+		for(int b = 0; b < BUCKETS; b++)
+		{
+			seen += m_buckets[b];
+			if(seen >= target) return min(upper(b),m_max);
+		}
+		return m_max;
+	}
+
+private:
+	// 0 for less than 1us. then 1 + 8 * e + (fraction above 2^e in eighths)
+	static int bucket(double us)
+	{
+		if(us < 1.0) return 0;
+		int e;
+		double m = frexp(us,&e);	// us = m * 2^e, 0.5 <= m < 1
+		int b = 1 + 8 * (e - 1) + (int)((m * 2.0 - 1.0) * 8.0);
+		return min(b,(int)BUCKETS - 1);
+	}
+
+	static double upper(int b)
+	{
+		if(b == 0) return 1.0;
+		int e = (b - 1) / 8, sub = (b - 1) % 8;
+		return ldexp(1.0 + (sub + 1) / 8.0,e);
+	}
+
+	unsigned int m_buckets[BUCKETS];
+	unsigned int m_count;
+	double m_sum;
+	double m_max;
+};
+
+// all of them are taken on the main thread. worker tasks are timed as a part of their callers
+class Profiler
+{
+public:
+	Profiler()
+	{
+		LARGE_INTEGER freq;
+		QueryPerformanceFrequency(&freq);
+		m_us_per_tick = 1000000.0 / (double)freq.QuadPart;
+		Reset();
+	}
+
+	void Reset()
+	{
+		for(int i = 0; i < PROFILE_SECTION_COUNT; i++) m_sections[i].Reset();
+		for(int i = 0; i < PROFILE_COUNTER_COUNT; i++) m_counters[i] = 0;
+	}
+
+	void AddTicks(int section, LONGLONG ticks) { m_sections[section].Add(ticks * m_us_per_tick); }
+	void Count(int counter, int n) { m_counters[counter] += n; }
+
+	// csv through debuglog, and json into the file EXMOVE_PROFILE_FILE names if it is set
+	void Dump(MQDocument doc)
+	{
+		debuglog(doc,"section,count,mean_us,p50_us,p95_us,p99_us,max_us");
+		for(int i = 0; i < PROFILE_SECTION_COUNT; i++)
+		{
+			const LatencyHistogram& h = m_sections[i];
+			if(h.GetCount() == 0) continue;
+			debuglog(doc,"%s,%u,%.1f,%.1f,%.1f,%.1f,%.1f",section_name(i),h.GetCount(),h.GetMean(),h.GetPercentile(0.5),h.GetPercentile(0.95),h.GetPercentile(0.99),h.GetMax());
+		}
+		debuglog(doc,"counter,total");
+		for(int i = 0; i < PROFILE_COUNTER_COUNT; i++) debuglog(doc,"%s,%lld",counter_name(i),(long long)m_counters[i]);
+
+		char path[MAX_PATH];
+		DWORD len = GetEnvironmentVariableA("EXMOVE_PROFILE_FILE",path,MAX_PATH);
+		if(len == 0 || len >= MAX_PATH) return;
+		FILE* fp = NULL;
+		if(fopen_s(&fp,path,"w") != 0 || fp == NULL) return;
+		fprintf(fp,"{\n  \"sections\": {");
+		bool first = true;
+		for(int i = 0; i < PROFILE_SECTION_COUNT; i++)
+		{
+			const LatencyHistogram& h = m_sections[i];
+			if(h.GetCount() == 0) continue;
+			fprintf(fp,"%s\n    \"%s\": { \"count\": %u, \"mean_us\": %.1f, \"p50_us\": %.1f, \"p95_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f }",
+				first ? "" : ",",section_name(i),h.GetCount(),h.GetMean(),h.GetPercentile(0.5),h.GetPercentile(0.95),h.GetPercentile(0.99),h.GetMax());
+			first = false;
+		}
+		fprintf(fp,"\n  },\n  \"counters\": {");
+		for(int i = 0; i < PROFILE_COUNTER_COUNT; i++) fprintf(fp,"%s\n    \"%s\": %lld",i ? "," : "",counter_name(i),(long long)m_counters[i]);
+		fprintf(fp,"\n  }\n}\n");
+		fclose(fp);
+	}
+
+private:
+	static const char* section_name(int i)
+	{
+		static const char* names[PROFILE_SECTION_COUNT] = { "OnMouseMove", "pick_target", "refresh_cache", "refresh_edge_cache", "get_selection", "drag", "regional_select", "render_visibility", "soft_selection" };
+		return names[i];
+	}
+
+	static const char* counter_name(int i)
+	{
+		static const char* names[PROFILE_COUNTER_COUNT] = { "vertices_projected", "vertices_tested", "faces_tested" };
+		return names[i];
+	}
+
+	double m_us_per_tick;
+	LatencyHistogram m_sections[PROFILE_SECTION_COUNT];
+	LONGLONG m_counters[PROFILE_COUNTER_COUNT];
+};
+
+static Profiler s_profiler;
+
+class ProfileScope
+{
+public:
+	ProfileScope(int section) : m_section(section) { QueryPerformanceCounter(&m_start); }
+	~ProfileScope()
+	{
+		LARGE_INTEGER end;
+		QueryPerformanceCounter(&end);
+		s_profiler.AddTicks(m_section,end.QuadPart - m_start.QuadPart);
+	}
+
+private:
+	int m_section;
+	LARGE_INTEGER m_start;
+};
+
+#define PROFILE_SCOPE(section) ProfileScope profile_scope(section)
+#define PROFILE_COUNT(counter,n) s_profiler.Count(counter,n)
+#define PROFILE_DUMP(doc) { s_profiler.Dump(doc); s_profiler.Reset(); }
+
+#else
+
+#define PROFILE_SCOPE(section)
+#define PROFILE_COUNT(counter,n)
+#define PROFILE_DUMP(doc)
+
+#endif
+
 enum ObjectEnumerator_SkipOption {
 	OE_SKIPLOCKED = 0x1,
 	OE_SKIPHIDDEN = 0x2,
@@ -120,20 +325,24 @@ public:
 		MQPoint p(0,0,0);
 		if(IsEmpty()) return p;
 		MQObject obj = doc->GetObject(index_o);
-		int indices[5];
+		std::vector<int> indices;
 		int pcount;
 		if(obj == NULL) return p;
 		switch(type)
 		{
 		case SELEL_FACE:
-			obj->GetFacePointArray(index_1,indices);
 			pcount = obj->GetFacePointCount(index_1);
+			if(pcount == 0) break;
+			indices.resize(pcount);
+			obj->GetFacePointArray(index_1,&indices[0]);
 			for(int i=0;i<pcount;i++) p += obj->GetVertex(indices[i]);
 			p /= (float)pcount;
 			break;
 		case SELEL_LINE:
-			obj->GetFacePointArray(index_1,indices);
 			pcount = obj->GetFacePointCount(index_1);
+			if(pcount == 0) break;
+			indices.resize(pcount);
+			obj->GetFacePointArray(index_1,&indices[0]);
 			p += obj->GetVertex(indices[index_2]);
 			p += obj->GetVertex(indices[(index_2+1)%pcount]);
 			p /= 2.0f;
@@ -201,201 +410,2845 @@ private:
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-class ExMovePlugin : public MQCommandPlugin
+// vertex -> faces lookup table of an object, stored as CSR (offsets + face list)
+class VertexFaceAdjacency
 {
 public:
-	ExMovePlugin() 
+	VertexFaceAdjacency() {}
+
+	void Clear() { m_offsets.clear(); m_faces.clear(); }
+	bool IsValid() const { return !m_offsets.empty(); }
+
+	int GetVertexCount() const { return m_offsets.empty() ? 0 : (int)m_offsets.size() - 1; }
+
+	// count of faces which contain the vertex
+	int GetFaceCount(int v) const 
 	{
-		m_highlightedelement.Reset();
-		m_moved = false;
+		if(v < 0 || v >= GetVertexCount()) return 0;
+		return m_offsets[v+1] - m_offsets[v];
 	}
-	~ExMovePlugin()
+	// faces which contain the vertex, in ascending order of face index
+	const int* GetFaces(int v) const
 	{
+		if(GetFaceCount(v) == 0) return NULL;
+		return &m_faces[m_offsets[v]];
 	}
 
-	void GetPlugInID(DWORD *Product, DWORD *ID)
+	void Build(MQObject obj)
 	{
-		*Product = 0xabcdef0e;
-		*ID      = 0x00101010;
-	}
-
-	const char *GetPlugInName(void) { return "N-Move ver.1.0.1      Copyright(C) 2007 kth"; }
+		Clear();
 
-	const char *EnumString(void) { return "N-Move"; }
+		int vcount = obj->GetVertexCount();
+		int fcount = obj->GetFaceCount();
+		m_offsets.assign(vcount + 1, 0);
 
-	BOOL Initialize() { return TRUE; }
-	void Exit() {}
+		std::vector<int> indices;
 
-	BOOL Activate(MQDocument doc, BOOL flag);
+		// count references of each vertex
+		for(int f = 0; f < fcount; f++)
+		{
+			int pcount = obj->GetFacePointCount(f);
+			if(pcount == 0) continue;
+			indices.resize(pcount);
+			obj->GetFacePointArray(f,&indices[0]);
+			for(int i = 0; i < pcount; i++)
+			{
+				if(is_duplicated_corner(indices,i) || indices[i] < 0 || indices[i] >= vcount) continue;
+				m_offsets[indices[i]+1]++;
+			}
+		}
+		for(int v = 0; v < vcount; v++) m_offsets[v+1] += m_offsets[v];
 
-	BOOL OnMouseMove(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state);
-	void OnDraw(MQDocument doc, MQScene scene, int width, int height);
+		// fill face indices. faces are visited in ascending order so each list is sorted
+		m_faces.resize(m_offsets[vcount]);
+		std::vector<int> cursor(m_offsets.begin(), m_offsets.end() - 1);
+		for(int f = 0; f < fcount; f++)
+		{
+			int pcount = obj->GetFacePointCount(f);
+			if(pcount == 0) continue;
+			indices.resize(pcount);
+			obj->GetFacePointArray(f,&indices[0]);
+			for(int i = 0; i < pcount; i++)
+			{
+				if(is_duplicated_corner(indices,i) || indices[i] < 0 || indices[i] >= vcount) continue;
+				m_faces[cursor[indices[i]]++] = f;
+			}
+		}
+	}
 
-	BOOL OnLeftButtonDown(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state);
-	BOOL OnLeftButtonMove(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state);
-	BOOL OnLeftButtonUp(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state);
+	// after a local edit. removed faces refered removed_corners, added faces are already in the object
+	void Patch(MQObject obj, const std::vector<int>& removed, const std::vector< std::vector<int> >& removed_corners, const std::vector<int>& added)
+	{
+		int vcount = obj->GetVertexCount();
+		int oldvcount = GetVertexCount();
 
-	BOOL OnRightButtonDown(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state);
+		// new face lists of the touched vertices
+		std::map<int, std::vector<int> > lists;
+		for(size_t r = 0; r < removed.size(); r++)
+		{
+			const std::vector<int>& corners = removed_corners[r];
+			for(size_t i = 0; i < corners.size(); i++)
+			{
+				std::vector<int>& list = touch(lists,corners[i]);
+				list.erase(std::remove(list.begin(),list.end(),removed[r]),list.end());
+			}
+		}
+		std::vector<int> indices;
+		for(size_t a = 0; a < added.size(); a++)
+		{
+			int pcount = obj->GetFacePointCount(added[a]);
+			if(pcount == 0) continue;
+			indices.resize(pcount);
+			obj->GetFacePointArray(added[a],&indices[0]);
+			for(int i = 0; i < pcount; i++)
+			{
+				if(is_duplicated_corner(indices,i) || indices[i] < 0 || indices[i] >= vcount) continue;
+				std::vector<int>& list = touch(lists,indices[i]);
+				list.insert(std::lower_bound(list.begin(),list.end(),added[a]),added[a]);
+			}
+		}
 
-	void OnObjectModified(MQDocument doc) { refresh_edge_cache(doc); m_cache_last_camera_pos.x = FLT_MAX; }
-	void OnUpdateObjectList(MQDocument doc) { m_cache_last_camera_pos.x = FLT_MAX; }
+		// splice them into the table
+		std::vector<int> offsets(vcount + 1, 0);
+		std::vector<int> faces;
+		faces.reserve(m_faces.size() + added.size() * 4);
+		for(int v = 0; v < vcount; v++)
+		{
+			std::map<int, std::vector<int> >::iterator it = lists.find(v);
+			if(it != lists.end()) faces.insert(faces.end(),it->second.begin(),it->second.end());
+			else if(v < oldvcount) faces.insert(faces.end(),m_faces.begin() + m_offsets[v],m_faces.begin() + m_offsets[v+1]);
+			offsets[v+1] = (int)faces.size();
+		}
+		m_offsets.swap(offsets);
+		m_faces.swap(faces);
+	}
 
+private:
+	// a degenerated face may refer a vertex twice. count it only once
+	static bool is_duplicated_corner(const std::vector<int>& indices, int i)
+	{
+		for(int j = 0; j < i; j++) if(indices[j] == indices[i]) return true;
+		return false;
+	}
 
+	std::vector<int>& touch(std::map<int, std::vector<int> >& lists, int v)
+	{
+		std::map<int, std::vector<int> >::iterator it = lists.find(v);
+		if(it != lists.end()) return it->second;
+		std::vector<int>& list = lists[v];
+		if(GetFaceCount(v) > 0) list.assign(GetFaces(v),GetFaces(v) + GetFaceCount(v));
+		return list;
+	}
 
+	std::vector<int> m_offsets;
+	std::vector<int> m_faces;
+};
 
-	//void OnUpdateUndo(MQDocument doc, int i1, int i2) { m_cache_last_camera_pos.x = FLT_MAX; }
+// set of undirected edges (pairs of vertex indices) by open addressing
+class EdgeHashSet
+{
+public:
+	EdgeHashSet() { m_mask = 0; m_count = 0; }
 
-private:
-	void refresh_cache(MQDocument doc,MQScene scene);
-	void refresh_edge_cache(MQDocument doc);
-	void pick_target(MQDocument doc, MQScene scene, POINT& mousepos, MQSelectElement* elm);
-	BOOL marge_vertices(MQDocument doc, MQScene scene);
-	void regional_select(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state);
+	// prepare for the expected count of edges. the table is kept at most half full
+	void Reset(int capacity)
+	{
+		unsigned int size = 64;
+		while(size < (unsigned int)capacity * 2) size <<= 1;
+		m_mask = size - 1;
+		m_count = 0;
+		m_slots.assign(size, std::pair<int,int>(-1,-1));
+	}
 
-	MQSelectElement m_highlightedelement;
+	// returns true if the edge was not in the set
+	bool Insert(int a, int b)
+	{
+		if(a < b) std::swap(a,b);
+		if((unsigned int)(m_count + 1) * 2 > m_mask + 1) grow();
 
-	bool m_regional_select_mode;
-	bool m_moved;
-	MQSelectElement m_togglereserve;
+		unsigned int i = hash(a,b) & m_mask;
+		while(m_slots[i].first != -1)
+		{
+			if(m_slots[i].first == a && m_slots[i].second == b) return false;
+			i = (i + 1) & m_mask;
+		}
+		m_slots[i].first = a;
+		m_slots[i].second = b;
+		m_count++;
+		return true;
+	}
 
-	std::vector<MQSelectVertex> m_selection;
-	std::vector<MQSelectVertex> m_symmetry;
-	std::map<MQSelectVertex,MQPoint> m_normalmap;
+	bool Contains(int a, int b) const
+	{
+		if(a < b) std::swap(a,b);
+		if(m_slots.empty()) return false;
 
-	float m_sc_dragbegin_z;
-	LONG m_mouse_sc_drag_x;
-	
-	MQPoint m_mouse_drag;
-	MQPoint m_mouse_drag_ignorey;
+		unsigned int i = hash(a,b) & m_mask;
+		while(m_slots[i].first != -1)
+		{
+			if(m_slots[i].first == a && m_slots[i].second == b) return true;
+			i = (i + 1) & m_mask;
+		}
+		return false;
+	}
 
-	MQPoint m_mouse_sc_dragbegin;
+private:
+	static unsigned int hash(int a, int b)
+	{
+		unsigned int h = (unsigned int)a * 0x9E3779B1u ^ ((unsigned int)b + 0x7F4A7C15u) * 0x85EBCA77u;
+		return h ^ (h >> 15);
+	}
 
-	MQPoint m_cache_last_camera_pos;
-	MQScene m_cache_last_scene;
-	
-	std::map<int, std::vector<int> > m_cache_editable_vertices;
-	std::map<int, std::vector<int> > m_cache_editable_faces;
-	std::map<int, std::vector< std::vector<int> > > m_cache_edges;
+	void grow()
+	{
+		std::vector< std::pair<int,int> > slots;
+		slots.swap(m_slots);
+		Reset((int)(m_mask + 1));
+		for(size_t i = 0; i < slots.size(); i++) if(slots[i].first != -1) Insert(slots[i].first,slots[i].second);
+	}
 
-	MQColor m_color_highlight;
+	unsigned int m_mask;
+	int m_count;
+	std::vector< std::pair<int,int> > m_slots;
 };
 
-static  ExMovePlugin s_plugin;
+// unique edges of an object. an edge shared by faces belongs to the face of the smallest index.
+// stored flat as face offsets + corner slots, the edge of a slot i runs from corner i to i+1
+class FaceEdgeTable
+{
+public:
+	FaceEdgeTable() {}
 
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	void Clear() { m_offsets.clear(); m_slots.clear(); m_first.clear(); m_second.clear(); }
 
+	int GetFaceCount() const { return m_offsets.empty() ? 0 : (int)m_offsets.size() - 1; }
 
-static void find_faces_contains_vertex(MQObject obj, int vindex, std::vector<int>& out)
-{
-	out.reserve(8);
-	int fcount = obj->GetFaceCount();
-	for(int f = 0; f < fcount; f++)
+	// all edges in a row. edges of face f are [GetFirstEdge(f), GetFirstEdge(f+1))
+	int GetTotalEdgeCount() const { return (int)m_slots.size(); }
+	int GetFirstEdge(int f) const { return m_offsets[f]; }
+	const int* GetFirstVertices() const { return m_first.empty() ? NULL : &m_first[0]; }
+	const int* GetSecondVertices() const { return m_second.empty() ? NULL : &m_second[0]; }
+
+	int GetEdgeCount(int f) const 
 	{
-		int indices[5] = {-1,-1,-1,-1,-1};
-		obj->GetFacePointArray(f,indices);
-		
-		for(int i = 0; indices[i] != -1; i++)
-		{
-			if(vindex == indices[i]) { out.push_back(f); break; }
-		}
+		if(f < 0 || f >= GetFaceCount()) return 0;
+		return m_offsets[f+1] - m_offsets[f];
+	}
+	const int* GetEdges(int f) const
+	{
+		if(GetEdgeCount(f) == 0) return NULL;
+		return &m_slots[m_offsets[f]];
 	}
-}
 
+	size_t GetMemoryUsage() const { return (m_offsets.capacity() + m_slots.capacity() + m_first.capacity() + m_second.capacity()) * sizeof(int); }
 
-static void get_selection(MQDocument doc,MQScene scene,std::vector<MQSelectVertex>& out)
-{
-	int indices[4];
+	void Build(MQObject obj)
+	{
+		Clear();
 
-	int obj_count = doc->GetObjectCount();
+		int fcount = obj->GetFaceCount();
+		int ccount = 0;
+		for(int f = 0; f < fcount; f++) ccount += obj->GetFacePointCount(f);
 
-	std::set<MQSelectVertex> tmp;
+		// every edge is shared by two faces in a closed mesh
+		EdgeHashSet set;
+		set.Reset(ccount / 2 + 1);
 
-	// for each objects
-	ObjectEnumerator objenum(doc);
-	for(MQObject obj = NULL; (obj = objenum.next()) != NULL;)
+		m_offsets.reserve(fcount + 1);
+		m_slots.reserve(ccount / 2 + 1);
+		m_first.reserve(ccount / 2 + 1);
+		m_second.reserve(ccount / 2 + 1);
+		m_offsets.push_back(0);
+
+		std::vector<int> indices;
+		for(int f = 0; f < fcount; f++)
+		{
+			int ecount = obj->GetFacePointCount(f);
+			if(ecount > 0)
+			{
+				indices.resize(ecount);
+				obj->GetFacePointArray(f,&indices[0]);
+				for(int i = 0; i < ecount; i++)
+				{
+					int a = indices[i], b = indices[(i+1)%ecount];
+					if(set.Insert(a,b)) { m_slots.push_back(i); m_first.push_back(a); m_second.push_back(b); }
+				}
+			}
+			m_offsets.push_back((int)m_slots.size());
+		}
+	}
+
+	// after a local edit. adjacency has to be patched already.
+	// only faces sharing an edge with removed or added faces are visited again
+	void Patch(MQObject obj, const VertexFaceAdjacency& adjacency, const std::vector<int>& removed, const std::vector< std::vector<int> >& removed_corners, const std::vector<int>& added)
 	{
-		int o = objenum.GetIndex();
-		int face_count = obj->GetFaceCount();
+		int fcount = obj->GetFaceCount();
+		int oldfcount = GetFaceCount();
 
-		for(int f = 0; f < face_count; f++)
+		// edges whose owner may change
+		std::vector<int> indices;
+		std::vector< std::pair<int,int> > touched;
+		for(size_t r = 0; r < removed.size(); r++)
 		{
-			// pass through if it is invalid face (count of references to vertice = 0)
-			int ptcount = obj->GetFacePointCount(f);
-			if(ptcount == 0) continue;
+			const std::vector<int>& corners = removed_corners[r];
+			for(size_t i = 0; i < corners.size(); i++) touched.push_back(std::pair<int,int>(corners[i],corners[(i+1)%corners.size()]));
+		}
+		for(size_t a = 0; a < added.size(); a++)
+		{
+			int pcount = obj->GetFacePointCount(added[a]);
+			if(pcount == 0) continue;
+			indices.resize(pcount);
+			obj->GetFacePointArray(added[a],&indices[0]);
+			for(int i = 0; i < pcount; i++) touched.push_back(std::pair<int,int>(indices[i],indices[(i+1)%pcount]));
+		}
+		EdgeHashSet touchedset;
+		touchedset.Reset((int)touched.size());
+		for(size_t i = 0; i < touched.size(); i++) touchedset.Insert(touched[i].first,touched[i].second);
 
-			obj->GetFacePointArray(f,indices);
+		// faces around the touched edges, and the removed ones which lose all
+		std::set<int> affected(removed.begin(),removed.end());
+		for(size_t i = 0; i < touched.size(); i++)
+		{
+			const int* faces = adjacency.GetFaces(touched[i].first);
+			for(int k = 0; k < adjacency.GetFaceCount(touched[i].first); k++) affected.insert(faces[k]);
+		}
 
-			// selected is a face
-			if(doc->IsSelectFace(o,f))
+		// ascending order of faces, so the first claim on an edge is the owner's.
+		// a list holds (slot, first vertex, second vertex) in a row
+		std::map<int, std::vector<int> > lists;
+		EdgeHashSet claimed;
+		claimed.Reset((int)touched.size());
+		for(std::set<int>::iterator it = affected.begin(); it != affected.end(); ++it)
+		{
+			int f = *it;
+			std::vector<int>& list = lists[f];
+			int pcount = (f < fcount) ? obj->GetFacePointCount(f) : 0;
+			if(pcount == 0) continue;
+			indices.resize(pcount);
+			obj->GetFacePointArray(f,&indices[0]);
+
+			const int* oldslots = (f < oldfcount) ? GetEdges(f) : NULL;
+			int oldcount = (f < oldfcount) ? GetEdgeCount(f) : 0;
+			for(int i = 0; i < pcount; i++)
 			{
-				for(int p = 0; p < ptcount; p++)
-					tmp.insert(MQSelectVertex(o,indices[p]));
-				continue;
+				int a = indices[i], b = indices[(i+1)%pcount];
+				bool owned;
+				if(touchedset.Contains(a,b)) owned = claimed.Insert(a,b);
+				else owned = std::find(oldslots,oldslots + oldcount,i) != oldslots + oldcount;
+				if(owned) { list.push_back(i); list.push_back(a); list.push_back(b); }
 			}
+		}
 
-			for(int p = 0; p < ptcount; p++)
+		// splice them into the table
+		std::vector<int> offsets(fcount + 1, 0);
+		std::vector<int> slots, first, second;
+		slots.reserve(m_slots.size() + added.size() * 4);
+		first.reserve(slots.capacity());
+		second.reserve(slots.capacity());
+		for(int f = 0; f < fcount; f++)
+		{
+			std::map<int, std::vector<int> >::iterator it = lists.find(f);
+			if(it != lists.end())
 			{
-				if(doc->IsSelectLine(o,f,p))
+				for(size_t k = 0; k < it->second.size(); k += 3)
 				{
-					tmp.insert(MQSelectVertex(o,indices[p]));
-					tmp.insert(MQSelectVertex(o,indices[(p+1)%ptcount]));
-				}
-				if(doc->IsSelectVertex(o,indices[p]))
-				{
-					tmp.insert(MQSelectVertex(o,indices[p]));
+					slots.push_back(it->second[k]);
+					first.push_back(it->second[k+1]);
+					second.push_back(it->second[k+2]);
 				}
 			}
+			else if(f < oldfcount)
+			{
+				slots.insert(slots.end(),m_slots.begin() + m_offsets[f],m_slots.begin() + m_offsets[f+1]);
+				first.insert(first.end(),m_first.begin() + m_offsets[f],m_first.begin() + m_offsets[f+1]);
+				second.insert(second.end(),m_second.begin() + m_offsets[f],m_second.begin() + m_offsets[f+1]);
+			}
+			offsets[f+1] = (int)slots.size();
 		}
+		m_offsets.swap(offsets);
+		m_slots.swap(slots);
+		m_first.swap(first);
+		m_second.swap(second);
 	}
 
-	for(std::set<MQSelectVertex>::iterator it = tmp.begin(); it != tmp.end(); ++it)
-	{
-		out.push_back(*it);
-	}
-}	
+private:
+	std::vector<int> m_offsets;
+	std::vector<int> m_slots;
+	std::vector<int> m_first;	// vertex at the slot
+	std::vector<int> m_second;	// vertex at the next corner
+};
 
-static void get_symmetry_vertices(MQDocument doc, std::vector<MQSelectVertex>& in, std::vector<MQSelectVertex>& out)
+// topology of an object at the time its edge and adjacency caches were built.
+// the hash is a sum over faces, so it can follow local edits
+struct TopologySignature
 {
-	if(!s_editoption.Symmetry) return;
+	TopologySignature() { vcount = -1; fcount = -1; hash = 0; version = 0; }
 
-	//float distance = s_editoption.SymmetryDistance * s_editoption.SymmetryDistance;
-	// we get only 0.0. I don't know why. 
-	float distance = 1.0f;
+	int vcount;
+	int fcount;
+	unsigned int hash;
+	// counted up whenever the topology is found changed
+	unsigned int version;
 
-	for(std::vector<MQSelectVertex>::iterator it = in.begin(); it != in.end(); ++it)
-	{
-		MQObject obj = doc->GetObject(it->object);
-		if(obj == NULL) continue;
+	bool IsSameTopology(const TopologySignature& a) const { return vcount == a.vcount && fcount == a.fcount && hash == a.hash; }
 
-		MQPoint p0 = obj->GetVertex(it->vertex);
-		p0.x = -p0.x;
+	void Compute(MQObject obj)
+	{
+		vcount = obj->GetVertexCount();
+		fcount = obj->GetFaceCount();
+		hash = 0;
 
-		float mindist = distance;
-		int symmetryv = -1;
-		int vcount = obj->GetVertexCount();
-		for(int i = 0; i < vcount; i++) 
+		std::vector<int> indices;
+		for(int f = 0; f < fcount; f++)
 		{
-			if(obj->GetVertexRefCount(i) == 0) continue;
-	
-			MQPoint p1 = obj->GetVertex(i);
-
-			float len = (p0-p1).norm();
+			int pcount = obj->GetFacePointCount(f);
+			if(pcount == 0) continue;
+			indices.resize(pcount);
+			obj->GetFacePointArray(f,&indices[0]);
+			hash += HashFace(f,&indices[0],pcount);
+		}
+	}
 
-			if(len > mindist) continue;
+	// an invalid face (no corners) counts 0
+	static unsigned int HashFace(int f, const int* indices, int pcount)
+	{
+		if(pcount == 0) return 0;
+		unsigned int h = 2166136261u ^ (unsigned int)f;
+		for(int i = 0; i < pcount; i++) { h ^= (unsigned int)indices[i]; h *= 16777619u; }
+		return h * 0x9E3779B1u;
+	}
+};
 
-			mindist = len;
-			symmetryv = i;
-		}
-		
-		if(symmetryv != -1) out.push_back(MQSelectVertex(it->object,symmetryv));
+// positions of all vertices of an object, bit for bit. tells which objects others have moved
+static unsigned int get_position_hash(MQObject obj)
+{
+	int vcount = obj->GetVertexCount();
+	unsigned int h = 2166136261u ^ (unsigned int)vcount;
+	for(int v = 0; v < vcount; v++)
+	{
+		MQPoint p = obj->GetVertex(v);
+		unsigned int bits[3];
+		memcpy(bits,&p.x,sizeof(float)); memcpy(bits + 1,&p.y,sizeof(float)); memcpy(bits + 2,&p.z,sizeof(float));
+		h = (h ^ bits[0]) * 16777619u;
+		h = (h ^ bits[1]) * 16777619u;
+		h = (h ^ bits[2]) * 16777619u;
 	}
+	return h;
 }
 
-static bool is_point_in_triangle_2d(const MQPoint& p, const MQPoint& t1, const MQPoint& t2, const MQPoint& t3)
+// bounding volume hierarchy over the faces of an object, in world space.
+// nodes are stored in depth first order, so the left child of a node is the next one
+class FaceBVH
 {
-	return (
-		((t2.x-t1.x) * (p.y-t1.y) - (t2.y-t1.y) * (p.x-t1.x) > 0) &&
-		((t3.x-t2.x) * (p.y-t2.y) - (t3.y-t2.y) * (p.x-t2.x) > 0) &&
+public:
+	FaceBVH() { m_version = 0; m_dirty = false; m_depth = 0; }
+
+	void Clear() { m_nodes.clear(); m_faces.clear(); m_corner_offsets.clear(); m_corners.clear(); m_dirty = false; m_depth = 0; }
+
+	bool IsBuiltFor(unsigned int version) const { return !m_corner_offsets.empty() && m_version == version; }
+
+	// vertices have been moved. bounds are refitted on next use
+	void MarkDirty() { m_dirty = true; }
+	bool IsDirty() const { return m_dirty; }
+
+	void Build(MQObject obj, unsigned int version)
+	{
+		Clear();
+		m_version = version;
+
+		int fcount = obj->GetFaceCount();
+		m_corner_offsets.reserve(fcount + 1);
+		m_corner_offsets.push_back(0);
+		for(int f = 0; f < fcount; f++)
+		{
+			int pcount = obj->GetFacePointCount(f);
+			if(pcount > 0)
+			{
+				m_corners.resize(m_corner_offsets.back() + pcount);
+				obj->GetFacePointArray(f,&m_corners[m_corner_offsets.back()]);
+				m_faces.push_back(f);
+			}
+			m_corner_offsets.push_back((int)m_corners.size());
+		}
+
+		std::vector<MQPoint> positions;
+		read_positions(obj,positions);
+
+		std::vector<MQPoint> fmin(fcount), fmax(fcount), centroid(fcount);
+		for(size_t i = 0; i < m_faces.size(); i++)
+		{
+			int f = m_faces[i];
+			face_bounds(positions,f,fmin[f],fmax[f]);
+			centroid[f] = (fmin[f] + fmax[f]) * 0.5f;
+		}
+
+		if(m_faces.empty()) return;
+		m_nodes.reserve(m_faces.size() / 2 + 1);
+		build_node(0,(int)m_faces.size(),0,fmin,fmax,centroid);
+	}
+
+	// recompute bounds bottom up. the tree itself is kept
+	void Refit(MQObject obj)
+	{
+		m_dirty = false;
+		if(m_nodes.empty()) return;
+
+		std::vector<MQPoint> positions;
+		read_positions(obj,positions);
+
+		// children come after their parent
+		for(int n = (int)m_nodes.size() - 1; n >= 0; n--)
+		{
+			Node& node = m_nodes[n];
+			if(node.count > 0)
+			{
+				face_bounds(positions,m_faces[node.start],node.bmin,node.bmax);
+				for(int i = 1; i < node.count; i++)
+				{
+					MQPoint fmin, fmax;
+					face_bounds(positions,m_faces[node.start + i],fmin,fmax);
+					merge(node.bmin,node.bmax,fmin,fmax);
+				}
+			}
+			else
+			{
+				node.bmin = m_nodes[n+1].bmin;
+				node.bmax = m_nodes[n+1].bmax;
+				merge(node.bmin,node.bmax,m_nodes[node.start].bmin,m_nodes[node.start].bmax);
+			}
+		}
+	}
+
+	// faces whose bounds may come within a cone around the ray. the radius at distance t from the origin is r0 + slope * t
+	void QueryCone(const MQPoint& origin, const MQPoint& dir, float r0, float slope, std::vector<int>& out) const
+	{
+		if(m_nodes.empty()) return;
+
+		// a pending right child for each level above the node taken, so the stack never grows beyond the depth
+		int nodes[64];
+		std::vector<int> nodes_large;
+		int* stack = nodes;
+		if(m_depth + 2 > 64) { nodes_large.resize(m_depth + 2); stack = &nodes_large[0]; }
+
+		int sp = 0;
+		stack[sp++] = 0;
+		while(sp > 0)
+		{
+			const Node& node = m_nodes[stack[--sp]];
+
+			MQPoint center = (node.bmin + node.bmax) * 0.5f;
+			float h = (node.bmax - node.bmin).abs() * 0.5f;
+			MQPoint v = center - origin;
+			float t = GetInnerProduct(v,dir);
+			float perp = (v - dir * t).abs();
+			float radius = r0 + slope * (slope > 0 ? t + h : t - h);
+			if(radius < 0 || perp - h > radius) continue;
+
+			if(node.count > 0)
+			{
+				for(int i = 0; i < node.count; i++) out.push_back(m_faces[node.start + i]);
+			}
+			else
+			{
+				stack[sp++] = node.start;
+				stack[sp++] = (int)(&node - &m_nodes[0]) + 1;
+			}
+		}
+	}
+
+private:
+	struct Node
+	{
+		MQPoint bmin;
+		MQPoint bmax;
+		int start;	// first face for a leaf, right child for an inner node
+		int count;	// 0 for an inner node
+	};
+
+	// orders faces by the centroid along an axis
+	struct CentroidLess
+	{
+		const std::vector<MQPoint>* centroid;
+		int axis;
+		bool operator()(int a, int b) const
+		{
+			const MQPoint& pa = (*centroid)[a];
+			const MQPoint& pb = (*centroid)[b];
+			return (axis == 0) ? pa.x < pb.x : (axis == 1) ? pa.y < pb.y : pa.z < pb.z;
+		}
+	};
+
+	static void merge(MQPoint& bmin, MQPoint& bmax, const MQPoint& pmin, const MQPoint& pmax)
+	{
+		bmin.x = min(bmin.x,pmin.x); bmin.y = min(bmin.y,pmin.y); bmin.z = min(bmin.z,pmin.z);
+		bmax.x = max(bmax.x,pmax.x); bmax.y = max(bmax.y,pmax.y); bmax.z = max(bmax.z,pmax.z);
+	}
+
+	static void read_positions(MQObject obj, std::vector<MQPoint>& positions)
+	{
+		int vcount = obj->GetVertexCount();
+		positions.resize(vcount);
+		for(int v = 0; v < vcount; v++) positions[v] = obj->GetVertex(v);
+	}
+
+	void face_bounds(const std::vector<MQPoint>& positions, int f, MQPoint& bmin, MQPoint& bmax) const
+	{
+		bmin = bmax = positions[m_corners[m_corner_offsets[f]]];
+		for(int i = m_corner_offsets[f] + 1; i < m_corner_offsets[f+1]; i++)
+		{
+			const MQPoint& p = positions[m_corners[i]];
+			merge(bmin,bmax,p,p);
+		}
+	}
+
+	// split at the median of centroids along the longest axis
+	int build_node(int begin, int end, int depth, const std::vector<MQPoint>& fmin, const std::vector<MQPoint>& fmax, const std::vector<MQPoint>& centroid)
+	{
+		int index = (int)m_nodes.size();
+		m_nodes.push_back(Node());
+		m_depth = max(m_depth,depth);
+
+		MQPoint bmin = fmin[m_faces[begin]], bmax = fmax[m_faces[begin]];
+		MQPoint cmin = centroid[m_faces[begin]], cmax = cmin;
+		for(int i = begin + 1; i < end; i++)
+		{
+			int f = m_faces[i];
+			merge(bmin,bmax,fmin[f],fmax[f]);
+			merge(cmin,cmax,centroid[f],centroid[f]);
+		}
+		m_nodes[index].bmin = bmin;
+		m_nodes[index].bmax = bmax;
+
+		// median splits keep the depth at about log2(faces / 4)
+		if(end - begin <= 4)
+		{
+			m_nodes[index].start = begin;
+			m_nodes[index].count = end - begin;
+			return index;
+		}
+
+		MQPoint extent = cmax - cmin;
+		CentroidLess less;
+		less.centroid = &centroid;
+		less.axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z) ? 1 : 2;
+
+		int mid = (begin + end) / 2;
+		std::nth_element(m_faces.begin() + begin, m_faces.begin() + mid, m_faces.begin() + end, less);
+
+		build_node(begin,mid,depth + 1,fmin,fmax,centroid);
+		int right = build_node(mid,end,depth + 1,fmin,fmax,centroid);
+		m_nodes[index].start = right;
+		m_nodes[index].count = 0;
+		return index;
+	}
+
+	unsigned int m_version;
+	bool m_dirty;
+	int m_depth;	// of the deepest leaf
+
+	std::vector<Node> m_nodes;
+	std::vector<int> m_faces;
+	std::vector<int> m_corner_offsets;
+	std::vector<int> m_corners;
+};
+
+// corners of the faces of an object and triangles covering them, stored flat.
+// a triangle is 3 corner positions in its face, in the winding of the face. a convex face is a fan from corner 0,
+// so triangles and quads are split as they have always been
+class FaceTriangulation
+{
+public:
+	FaceTriangulation() { m_version = 0; }
+
+	void Clear() { m_corner_offsets.clear(); m_corners.clear(); m_triangle_offsets.clear(); m_triangles.clear(); }
+
+	bool IsBuiltFor(unsigned int version) const { return !m_corner_offsets.empty() && m_version == version; }
+
+	int GetFaceCount() const { return m_corner_offsets.empty() ? 0 : (int)m_corner_offsets.size() - 1; }
+
+	int GetCornerCount(int f) const { return m_corner_offsets[f+1] - m_corner_offsets[f]; }
+	const int* GetCorners(int f) const { return GetCornerCount(f) == 0 ? NULL : &m_corners[m_corner_offsets[f]]; }
+
+	int GetTriangleCount(int f) const { return (m_triangle_offsets[f+1] - m_triangle_offsets[f]) / 3; }
+	const int* GetTriangles(int f) const { return GetTriangleCount(f) == 0 ? NULL : &m_triangles[m_triangle_offsets[f]]; }
+
+	void Build(MQObject obj, unsigned int version)
+	{
+		Clear();
+		m_version = version;
+
+		int fcount = obj->GetFaceCount();
+		m_corner_offsets.reserve(fcount + 1);
+		m_triangle_offsets.reserve(fcount + 1);
+		m_corner_offsets.push_back(0);
+		m_triangle_offsets.push_back(0);
+
+		std::vector<MQPoint> points;
+		std::vector<int> ring;
+		for(int f = 0; f < fcount; f++)
+		{
+			int pcount = obj->GetFacePointCount(f);
+			if(pcount > 0)
+			{
+				m_corners.resize(m_corner_offsets.back() + pcount);
+				obj->GetFacePointArray(f,&m_corners[m_corner_offsets.back()]);
+			}
+			if(pcount == 3)
+			{
+				add_triangle(0,1,2);
+			}
+			else if(pcount > 3)
+			{
+				points.resize(pcount);
+				for(int i = 0; i < pcount; i++) points[i] = obj->GetVertex(m_corners[m_corner_offsets.back() + i]);
+				clip_ears(points,ring);
+			}
+			m_corner_offsets.push_back((int)m_corners.size());
+			m_triangle_offsets.push_back((int)m_triangles.size());
+		}
+	}
+
+private:
+	void add_triangle(int a, int b, int c)
+	{
+		m_triangles.push_back(a);
+		m_triangles.push_back(b);
+		m_triangles.push_back(c);
+	}
+
+	// on the plane of the face, dropping the axis the normal is the longest along
+	static void flatten(const MQPoint& p, int axis, float& u, float& v)
+	{
+		if(axis == 0) { u = p.y; v = p.z; }
+		else if(axis == 1) { u = p.z; v = p.x; }
+		else { u = p.x; v = p.y; }
+	}
+
+	// twice the signed area of a triangle on the plane. positive for the winding of the face
+	static float area2(const std::vector<float>& u, const std::vector<float>& v, int a, int b, int c)
+	{
+		return (u[b] - u[a]) * (v[c] - v[a]) - (v[b] - v[a]) * (u[c] - u[a]);
+	}
+
+	// removes an ear at a time, looking from corner 1 onward. a face which has no ear left (degenerated) is closed by a fan
+	void clip_ears(const std::vector<MQPoint>& points, std::vector<int>& ring)
+	{
+		int pcount = (int)points.size();
+
+		// Newell's normal gives the plane and which way is front
+		MQPoint n(0,0,0);
+		for(int i = 0; i < pcount; i++)
+		{
+			const MQPoint& a = points[i];
+			const MQPoint& b = points[(i+1)%pcount];
+			n.x += (a.y - b.y) * (a.z + b.z);
+			n.y += (a.z - b.z) * (a.x + b.x);
+			n.z += (a.x - b.x) * (a.y + b.y);
+		}
+		float ax = fabsf(n.x), ay = fabsf(n.y), az = fabsf(n.z);
+		int axis = (ax >= ay && ax >= az) ? 0 : (ay >= az) ? 1 : 2;
+		float sign = ((axis == 0) ? n.x : (axis == 1) ? n.y : n.z) < 0 ? -1.0f : 1.0f;
+
+		m_u.resize(pcount);
+		m_v.resize(pcount);
+		for(int i = 0; i < pcount; i++) { flatten(points[i],axis,m_u[i],m_v[i]); m_v[i] *= sign; }
+
+		ring.resize(pcount);
+		for(int i = 0; i < pcount; i++) ring[i] = i;
+
+		int i = 1, tried = 0;
+		while(ring.size() > 3)
+		{
+			int count = (int)ring.size();
+			int a = ring[(i + count - 1) % count], b = ring[i], c = ring[(i + 1) % count];
+
+			bool ear = area2(m_u,m_v,a,b,c) > 0;
+			for(int k = 0; ear && k < count; k++)
+			{
+				int p = ring[k];
+				if(p == a || p == b || p == c) continue;
+				if(area2(m_u,m_v,a,b,p) >= 0 && area2(m_u,m_v,b,c,p) >= 0 && area2(m_u,m_v,c,a,p) >= 0) ear = false;
+			}
+
+			if(ear || tried >= count)
+			{
+				add_triangle(a,b,c);
+				ring.erase(ring.begin() + i);
+				if(i >= (int)ring.size()) i = 0;
+				tried = 0;
+			}
+			else
+			{
+				i = (i + 1) % count;
+				tried++;
+			}
+		}
+		add_triangle(ring[0],ring[1],ring[2]);
+	}
+
+	unsigned int m_version;
+
+	std::vector<int> m_corner_offsets;
+	std::vector<int> m_corners;
+	std::vector<int> m_triangle_offsets;
+	std::vector<int> m_triangles;
+	std::vector<float> m_u, m_v;
+};
+
+// vertex positions of an object bucketed by a uniform grid. cells are hashed into a fixed count of buckets
+class VertexSpatialGrid
+{
+public:
+	VertexSpatialGrid() { m_cellsize = 0; m_mask = 0; }
+
+	void Clear() { m_offsets.clear(); m_vertices.clear(); m_points.clear(); m_cellsize = 0; m_mask = 0; }
+	bool IsValid() const { return !m_offsets.empty(); }
+	float GetCellSize() const { return m_cellsize; }
+
+	void Build(MQObject obj, float cellsize)
+	{
+		Clear();
+		m_cellsize = cellsize;
+
+		int vcount = obj->GetVertexCount();
+
+		unsigned int buckets = 64;
+		while(buckets < (unsigned int)vcount) buckets <<= 1;
+		m_mask = buckets - 1;
+		m_offsets.assign(buckets + 1, 0);
+
+		// referred vertices only. count them up for each bucket
+		std::vector<unsigned int> vbucket(vcount, 0xffffffff);
+		for(int v = 0; v < vcount; v++)
+		{
+			if(obj->GetVertexRefCount(v) == 0) continue;
+			MQPoint p = obj->GetVertex(v);
+			vbucket[v] = hash_cell(cell_coord(p.x),cell_coord(p.y),cell_coord(p.z));
+			m_offsets[vbucket[v]+1]++;
+		}
+		for(unsigned int b = 0; b < buckets; b++) m_offsets[b+1] += m_offsets[b];
+
+		m_vertices.resize(m_offsets[buckets]);
+		m_points.resize(m_offsets[buckets]);
+		std::vector<int> cursor(m_offsets.begin(), m_offsets.end() - 1);
+		for(int v = 0; v < vcount; v++)
+		{
+			if(vbucket[v] == 0xffffffff) continue;
+			int slot = cursor[vbucket[v]]++;
+			m_vertices[slot] = v;
+			m_points[slot] = obj->GetVertex(v);
+		}
+	}
+
+	// nearest vertex within the radius, or -1. ties are resolved to the larger vertex index
+	int FindNearest(const MQPoint& p, float radius) const
+	{
+		if(!IsValid()) return -1;
+
+		float mindist = radius * radius;
+		int found = -1;
+
+		int x0 = cell_coord(p.x - radius), x1 = cell_coord(p.x + radius);
+		int y0 = cell_coord(p.y - radius), y1 = cell_coord(p.y + radius);
+		int z0 = cell_coord(p.z - radius), z1 = cell_coord(p.z + radius);
+
+		for(int x = x0; x <= x1; x++)
+		for(int y = y0; y <= y1; y++)
+		for(int z = z0; z <= z1; z++)
+		{
+			unsigned int b = hash_cell(x,y,z);
+			for(int i = m_offsets[b]; i < m_offsets[b+1]; i++)
+			{
+				float len = (m_points[i] - p).norm();
+				if(len > mindist) continue;
+				if(len == mindist && m_vertices[i] < found) continue;
+				mindist = len;
+				found = m_vertices[i];
+			}
+		}
+		return found;
+	}
+
+	// distance from every vertex within the radius of any of the sources to the nearest of them.
+	// cells around the sources are visited once, and so is each vertex in them. dist has an entry for every vertex,
+	// FLT_MAX until it is reached, and vertices reached for the first time are added to reached. those flagged in skip are left alone
+	void GatherNearest(const std::vector<MQPoint>& sources, float radius, const std::vector<unsigned char>& skip, std::vector<float>& dist, std::vector<int>& reached) const
+	{
+		if(!IsValid() || sources.empty()) return;
+		int reach = max(1,(int)ceilf(radius / m_cellsize));
+
+		// sources sorted by the cell they are in
+		std::vector< std::pair<Cell,int> > order(sources.size());
+		for(size_t i = 0; i < sources.size(); i++) { order[i].first = get_cell(sources[i]); order[i].second = (int)i; }
+		std::sort(order.begin(),order.end());
+		std::vector<MQPoint> points(sources.size());
+		std::vector<Cell> cells;
+		std::vector<int> offsets;
+		for(size_t i = 0; i < order.size(); i++)
+		{
+			points[i] = sources[order[i].second];
+			if(cells.empty() || !(cells.back() == order[i].first)) { cells.push_back(order[i].first); offsets.push_back((int)i); }
+		}
+		offsets.push_back((int)order.size());
+
+		// any vertex within the radius is in a cell within reach of a source cell
+		std::vector<Cell> candidates;
+		candidates.reserve(cells.size() * (2 * reach + 1) * (2 * reach + 1) * (2 * reach + 1));
+		for(size_t c = 0; c < cells.size(); c++)
+		for(int dx = -reach; dx <= reach; dx++)
+		for(int dy = -reach; dy <= reach; dy++)
+		for(int dz = -reach; dz <= reach; dz++)
+		{
+			Cell n = { cells[c].x + dx, cells[c].y + dy, cells[c].z + dz };
+			candidates.push_back(n);
+		}
+		std::sort(candidates.begin(),candidates.end());
+		candidates.erase(std::unique(candidates.begin(),candidates.end()),candidates.end());
+
+		// sources around a candidate cell, by their distance from its center. d(v,s) >= d(c,s) - d(c,v) for a vertex v of it,
+		// so the sources of a vertex are read only until that bound passes the nearest one so far
+		std::vector< std::pair<float,int> > nearby;
+		std::vector<float> nearby_dist;
+		std::vector<MQPoint> nearby_points;
+		float slack = m_cellsize * 1e-4f;
+		for(size_t k = 0; k < candidates.size(); k++)
+		{
+			const Cell& cell = candidates[k];
+			MQPoint center((cell.x + 0.5f) * m_cellsize,(cell.y + 0.5f) * m_cellsize,(cell.z + 0.5f) * m_cellsize);
+			nearby.clear();
+			for(int dx = -reach; dx <= reach; dx++)
+			for(int dy = -reach; dy <= reach; dy++)
+			for(int dz = -reach; dz <= reach; dz++)
+			{
+				Cell n = { cell.x + dx, cell.y + dy, cell.z + dz };
+				std::vector<Cell>::const_iterator it = std::lower_bound(cells.begin(),cells.end(),n);
+				if(it == cells.end() || !(*it == n)) continue;
+				int c = (int)(it - cells.begin());
+				for(int j = offsets[c]; j < offsets[c+1]; j++) nearby.push_back(std::pair<float,int>((points[j] - center).abs(),j));
+			}
+			std::sort(nearby.begin(),nearby.end());
+			nearby_dist.resize(nearby.size());
+			nearby_points.resize(nearby.size());
+			for(size_t j = 0; j < nearby.size(); j++) { nearby_dist[j] = nearby[j].first; nearby_points[j] = points[nearby[j].second]; }
+
+			// distinct cells can share a bucket. only vertices of this cell are taken
+			unsigned int b = hash_cell(cell.x,cell.y,cell.z);
+			for(int i = m_offsets[b]; i < m_offsets[b+1]; i++)
+			{
+				int v = m_vertices[i];
+				if(skip[v]) continue;
+				const MQPoint& p = m_points[i];
+				if(!(get_cell(p) == cell)) continue;
+
+				float dc = (p - center).abs();
+				float best = FLT_MAX, bestlen = radius;
+				for(size_t j = 0; j < nearby_points.size(); j++)
+				{
+					if(nearby_dist[j] - dc > bestlen + slack) break;
+					float len = (nearby_points[j] - p).norm();
+					if(len < best) { best = len; bestlen = sqrtf(len); }
+				}
+				if(best > radius * radius) continue;
+
+				float& d = dist[v];
+				if(d == FLT_MAX) reached.push_back(v);
+				float len = sqrtf(best);
+				if(len < d) d = len;
+			}
+		}
+	}
+
+private:
+	struct Cell
+	{
+		int x, y, z;
+		bool operator<(const Cell& a) const { return (x != a.x) ? x < a.x : (y != a.y) ? y < a.y : z < a.z; }
+		bool operator==(const Cell& a) const { return x == a.x && y == a.y && z == a.z; }
+	};
+
+	int cell_coord(float f) const { return (int)floorf(f / m_cellsize); }
+	Cell get_cell(const MQPoint& p) const { Cell c = { cell_coord(p.x), cell_coord(p.y), cell_coord(p.z) }; return c; }
+
+	unsigned int hash_cell(int x, int y, int z) const
+	{
+		return (((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u) ^ ((unsigned int)z * 83492791u)) & m_mask;
+	}
+
+	float m_cellsize;
+	unsigned int m_mask;
+
+	std::vector<int> m_offsets;
+	std::vector<int> m_vertices;
+	std::vector<MQPoint> m_points;
+};
+
+// projected points bucketed by a 2d grid on the screen. cells are hashed into a fixed count of buckets
+class ScreenPointGrid
+{
+public:
+	ScreenPointGrid() { m_cellsize = 1.0f; m_mask = 0; }
+
+	void Clear() { m_offsets.clear(); m_indices.clear(); m_points.clear(); m_mask = 0; }
+
+	// indices[i] is projected to points[i]. points behind the camera (z < 0) are left out
+	void Build(const std::vector<int>& indices, const std::vector<MQPoint>& points, float cellsize)
+	{
+		Clear();
+		m_cellsize = cellsize;
+
+		int count = (int)indices.size();
+
+		unsigned int buckets = 64;
+		while(buckets < (unsigned int)count) buckets <<= 1;
+		m_mask = buckets - 1;
+		m_offsets.assign(buckets + 1, 0);
+
+		std::vector<unsigned int> pbucket(count, 0xffffffff);
+		for(int i = 0; i < count; i++)
+		{
+			if(points[i].z < 0) continue;
+			pbucket[i] = hash_cell(cell_coord(points[i].x),cell_coord(points[i].y));
+			m_offsets[pbucket[i]+1]++;
+		}
+		for(unsigned int b = 0; b < buckets; b++) m_offsets[b+1] += m_offsets[b];
+
+		m_indices.resize(m_offsets[buckets]);
+		m_points.resize(m_offsets[buckets]);
+		std::vector<int> cursor(m_offsets.begin(), m_offsets.end() - 1);
+		for(int i = 0; i < count; i++)
+		{
+			if(pbucket[i] == 0xffffffff) continue;
+			int slot = cursor[pbucket[i]]++;
+			m_indices[slot] = indices[i];
+			m_points[slot] = points[i];
+		}
+	}
+
+	// search a point nearer than mindist (squared, in screen pixels) around p. 
+	// ties are resolved to the larger index. returns true when index, mindist and z are updated
+	bool FindNearest(const MQPoint& p, float radius, float& mindist, int& index, float& z) const
+	{
+		if(m_offsets.empty()) return false;
+
+		bool found = false;
+
+		int x0 = cell_coord(p.x - radius), x1 = cell_coord(p.x + radius);
+		int y0 = cell_coord(p.y - radius), y1 = cell_coord(p.y + radius);
+
+		for(int x = x0; x <= x1; x++)
+		for(int y = y0; y <= y1; y++)
+		{
+			unsigned int b = hash_cell(x,y);
+			for(int i = m_offsets[b]; i < m_offsets[b+1]; i++)
+			{
+				const MQPoint& sp = m_points[i];
+				float dis2 = (sp.x-p.x)*(sp.x-p.x) + (sp.y-p.y)*(sp.y-p.y);
+				if(mindist < dis2) continue;
+				if(mindist == dis2 && m_indices[i] < index) continue;
+
+				mindist = dis2;
+				index = m_indices[i];
+				z = sp.z;
+				found = true;
+			}
+		}
+		return found;
+	}
+
+	// every point within the radius around p
+	void Gather(const MQPoint& p, float radius, std::vector<int>& indices, std::vector<MQPoint>& points) const
+	{
+		if(m_offsets.empty()) return;
+
+		int x0 = cell_coord(p.x - radius), x1 = cell_coord(p.x + radius);
+		int y0 = cell_coord(p.y - radius), y1 = cell_coord(p.y + radius);
+
+		// distinct cells can share a bucket. each bucket is read once
+		std::vector<unsigned int> buckets;
+		for(int x = x0; x <= x1; x++)
+		for(int y = y0; y <= y1; y++)
+		{
+			buckets.push_back(hash_cell(x,y));
+		}
+		std::sort(buckets.begin(),buckets.end());
+		buckets.erase(std::unique(buckets.begin(),buckets.end()),buckets.end());
+
+		for(size_t k = 0; k < buckets.size(); k++)
+		{
+			unsigned int b = buckets[k];
+			for(int i = m_offsets[b]; i < m_offsets[b+1]; i++)
+			{
+				const MQPoint& sp = m_points[i];
+				if((sp.x-p.x)*(sp.x-p.x) + (sp.y-p.y)*(sp.y-p.y) > radius * radius) continue;
+				indices.push_back(m_indices[i]);
+				points.push_back(sp);
+			}
+		}
+	}
+
+private:
+	int cell_coord(float f) const { return (int)floorf(f / m_cellsize); }
+
+	unsigned int hash_cell(int x, int y) const
+	{
+		return (((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u)) & m_mask;
+	}
+
+	float m_cellsize;
+	unsigned int m_mask;
+
+	std::vector<int> m_offsets;
+	std::vector<int> m_indices;
+	std::vector<MQPoint> m_points;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// solve a 4x4 linear system by gaussian elimination with partial pivoting. a and b are destroyed
+static bool solve_linear4(double a[4][4], double b[4], double x[4])
+{
+	for(int c = 0; c < 4; c++)
+	{
+		int pivot = c;
+		for(int r = c + 1; r < 4; r++) if(fabs(a[r][c]) > fabs(a[pivot][c])) pivot = r;
+		if(fabs(a[pivot][c]) < 1e-12) return false;
+		if(pivot != c)
+		{
+			for(int k = 0; k < 4; k++) std::swap(a[c][k],a[pivot][k]);
+			std::swap(b[c],b[pivot]);
+		}
+		for(int r = c + 1; r < 4; r++)
+		{
+			double f = a[r][c] / a[c][c];
+			for(int k = c; k < 4; k++) a[r][k] -= f * a[c][k];
+			b[r] -= f * b[c];
+		}
+	}
+	for(int r = 3; r >= 0; r--)
+	{
+		double v = b[r];
+		for(int k = r + 1; k < 4; k++) v -= a[r][k] * x[k];
+		x[r] = v / a[r][r];
+	}
+	return true;
+}
+
+// world to screen transform of a scene, as a 4x4 projective matrix.
+// MQScene does not expose its matrices, so it is recovered from Convert3DToScreen itself
+class ScreenProjection
+{
+public:
+	ScreenProjection() { m_valid = false; m_perspective = false; }
+
+	bool IsValid() const { return m_valid; }
+	void Invalidate() { m_valid = false; }
+
+	// center of the perspective projection. not available for parallel projections
+	bool GetEye(MQPoint& eye) const
+	{
+		if(!m_valid || !m_perspective) return false;
+		eye = m_eye;
+		return true;
+	}
+
+	// sample the scene at 5 points in general position, solve the projective basis and 
+	// verify the result at other points. if it does not reproduce the scene, it stays invalid
+	bool Extract(MQScene scene)
+	{
+		m_valid = false;
+
+		static const float samples[5][3] = {
+			{   0.0f,   0.0f, 0.3f },
+			{ 200.0f,   0.0f, 0.3f },
+			{   0.0f, 200.0f, 0.3f },
+			{   0.0f,   0.0f, 0.6f },
+			{ 200.0f, 200.0f, 0.6f },
+		};
+		static const float probes[4][3] = {
+			{ 100.0f,  50.0f, 0.2f },
+			{ 400.0f, 300.0f, 0.5f },
+			{  30.0f, 250.0f, 0.8f },
+			{ 600.0f, 120.0f, 0.95f },
+		};
+
+		double src[5][4], dst[5][4];
+		for(int i = 0; i < 5; i++)
+		{
+			MQPoint wp = scene->ConvertScreenTo3D(MQPoint(samples[i][0],samples[i][1],samples[i][2]));
+			MQPoint sp = scene->Convert3DToScreen(wp);
+			src[i][0] = wp.x; src[i][1] = wp.y; src[i][2] = wp.z; src[i][3] = 1.0;
+			dst[i][0] = sp.x; dst[i][1] = sp.y; dst[i][2] = sp.z; dst[i][3] = 1.0;
+		}
+
+		// A maps the canonical basis to the source points, B to the destination points. M = B * A^-1
+		double a[4][4], b[4][4];
+		if(!projective_basis(src,a) || !projective_basis(dst,b)) return false;
+
+		double ainv[4][4];
+		for(int c = 0; c < 4; c++)
+		{
+			double tmp[4][4], e[4] = {0,0,0,0}, col[4];
+			for(int r = 0; r < 4; r++) for(int k = 0; k < 4; k++) tmp[r][k] = a[r][k];
+			e[c] = 1.0;
+			if(!solve_linear4(tmp,e,col)) return false;
+			for(int r = 0; r < 4; r++) ainv[r][c] = col[r];
+		}
+		for(int r = 0; r < 4; r++) for(int c = 0; c < 4; c++)
+		{
+			double v = 0;
+			for(int k = 0; k < 4; k++) v += b[r][k] * ainv[k][c];
+			m_matrix[r][c] = v;
+		}
+		// normalize the scale to keep float precision
+		double scale = 0;
+		for(int c = 0; c < 4; c++) scale = max(scale,fabs(m_matrix[3][c]));
+		if(scale == 0) return false;
+		for(int r = 0; r < 4; r++) for(int c = 0; c < 4; c++) { m_matrix[r][c] /= scale; m_m[r][c] = (float)m_matrix[r][c]; }
+
+		// the eye is the point projected to infinity in every direction, where rows x, y and w are all 0
+		double det = det3(m_matrix[0][0],m_matrix[0][1],m_matrix[0][2], m_matrix[1][0],m_matrix[1][1],m_matrix[1][2], m_matrix[3][0],m_matrix[3][1],m_matrix[3][2]);
+		m_perspective = (fabs(m_matrix[3][0]) + fabs(m_matrix[3][1]) + fabs(m_matrix[3][2]) > 1e-7) && det != 0;
+		if(m_perspective)
+		{
+			double bx = -m_matrix[0][3], by = -m_matrix[1][3], bw = -m_matrix[3][3];
+			m_eye.x = (float)(det3(bx,m_matrix[0][1],m_matrix[0][2], by,m_matrix[1][1],m_matrix[1][2], bw,m_matrix[3][1],m_matrix[3][2]) / det);
+			m_eye.y = (float)(det3(m_matrix[0][0],bx,m_matrix[0][2], m_matrix[1][0],by,m_matrix[1][2], m_matrix[3][0],bw,m_matrix[3][2]) / det);
+			m_eye.z = (float)(det3(m_matrix[0][0],m_matrix[0][1],bx, m_matrix[1][0],m_matrix[1][1],by, m_matrix[3][0],m_matrix[3][1],bw) / det);
+		}
+
+		m_valid = true;
+
+		for(int i = 0; i < 4; i++)
+		{
+			MQPoint wp = scene->ConvertScreenTo3D(MQPoint(probes[i][0],probes[i][1],probes[i][2]));
+			MQPoint expected = scene->Convert3DToScreen(wp);
+			MQPoint actual = Project(wp);
+			if(fabs(actual.x - expected.x) > 0.05f || fabs(actual.y - expected.y) > 0.05f ||
+				fabs(actual.z - expected.z) > 1e-4f * (1.0f + fabs(expected.z)))
+			{
+				m_valid = false;
+				break;
+			}
+		}
+		return m_valid;
+	}
+
+	// points behind the eye are put far off the screen with negative z
+	MQPoint Project(const MQPoint& p) const
+	{
+		float w = m_m[3][0] * p.x + m_m[3][1] * p.y + m_m[3][2] * p.z + m_m[3][3];
+		if(w <= 0) return MQPoint(FLT_MAX,FLT_MAX,-1.0f);
+		return MQPoint(
+			(m_m[0][0] * p.x + m_m[0][1] * p.y + m_m[0][2] * p.z + m_m[0][3]) / w,
+			(m_m[1][0] * p.x + m_m[1][1] * p.y + m_m[1][2] * p.z + m_m[1][3]) / w,
+			(m_m[2][0] * p.x + m_m[2][1] * p.y + m_m[2][2] * p.z + m_m[2][3]) / w);
+	}
+
+	// project positions given as structure of arrays
+	void ProjectArray(const float* x, const float* y, const float* z, int count, MQPoint* out) const
+	{
+		int i = 0;
+#ifdef EXMOVE_USE_SSE
+		__m128 m[4][4];
+		for(int r = 0; r < 4; r++) for(int c = 0; c < 4; c++) m[r][c] = _mm_set1_ps(m_m[r][c]);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 offscreen = _mm_set1_ps(FLT_MAX);
+		const __m128 behind = _mm_set1_ps(-1.0f);
+
+		float sx[4], sy[4], sz[4];
+		for(; i + 4 <= count; i += 4)
+		{
+			__m128 px = _mm_loadu_ps(x + i);
+			__m128 py = _mm_loadu_ps(y + i);
+			__m128 pz = _mm_loadu_ps(z + i);
+
+			__m128 w  = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[3][0],px),_mm_mul_ps(m[3][1],py)),_mm_add_ps(_mm_mul_ps(m[3][2],pz),m[3][3]));
+			__m128 vx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][0],px),_mm_mul_ps(m[0][1],py)),_mm_add_ps(_mm_mul_ps(m[0][2],pz),m[0][3]));
+			__m128 vy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[1][0],px),_mm_mul_ps(m[1][1],py)),_mm_add_ps(_mm_mul_ps(m[1][2],pz),m[1][3]));
+			__m128 vz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[2][0],px),_mm_mul_ps(m[2][1],py)),_mm_add_ps(_mm_mul_ps(m[2][2],pz),m[2][3]));
+
+			__m128 front = _mm_cmpgt_ps(w,zero);
+			vx = _mm_or_ps(_mm_and_ps(front,_mm_div_ps(vx,w)),_mm_andnot_ps(front,offscreen));
+			vy = _mm_or_ps(_mm_and_ps(front,_mm_div_ps(vy,w)),_mm_andnot_ps(front,offscreen));
+			vz = _mm_or_ps(_mm_and_ps(front,_mm_div_ps(vz,w)),_mm_andnot_ps(front,behind));
+
+			_mm_storeu_ps(sx,vx);
+			_mm_storeu_ps(sy,vy);
+			_mm_storeu_ps(sz,vz);
+			for(int k = 0; k < 4; k++) { out[i+k].x = sx[k]; out[i+k].y = sy[k]; out[i+k].z = sz[k]; }
+		}
+#endif
+		for(; i < count; i++) out[i] = Project(MQPoint(x[i],y[i],z[i]));
+	}
+
+private:
+	static double det3(double a, double b, double c, double d, double e, double f, double g, double h, double i)
+	{
+		return a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+	}
+
+	// columns scaled so that they sum up to the 5th point
+	static bool projective_basis(double pts[5][4], double out[4][4])
+	{
+		double a[4][4], b[4], lambda[4];
+		for(int r = 0; r < 4; r++) { for(int c = 0; c < 4; c++) a[r][c] = pts[c][r]; b[r] = pts[4][r]; }
+		if(!solve_linear4(a,b,lambda)) return false;
+		for(int r = 0; r < 4; r++) for(int c = 0; c < 4; c++) out[r][c] = pts[c][r] * lambda[c];
+		return true;
+	}
+
+	bool m_valid;
+	bool m_perspective;
+	MQPoint m_eye;
+	double m_matrix[4][4];
+	float m_m[4][4];
+};
+
+// facing state of the faces of an object. kept to refresh it incrementally when the camera orbits
+struct FaceFacingCache
+{
+	FaceFacingCache() { scene = NULL; consistent = false; }
+
+	MQScene scene;
+	MQPoint eye;
+	// whether IsFrontFace agreed with the side of the face plane the eye was on
+	bool consistent;
+
+	std::vector<MQPoint> normal;
+	std::vector<MQPoint> center;
+	std::vector<float> plane_d;
+	std::vector<float> slack;   // distance of the farthest corner from the plane. FLT_MAX for faces without area
+	std::vector<float> bend;    // sine of the largest angle between the plane and a corner triangle
+	std::vector<float> dist;    // signed distance of the eye from the plane at the last test
+	std::vector<unsigned char> front;
+
+	// the side of the plane is reliable beyond this distance, whatever corners IsFrontFace looks at
+	float GetTolerance(int f, const MQPoint& p) const
+	{
+		if(slack[f] == FLT_MAX || bend[f] == FLT_MAX) return FLT_MAX;
+		return slack[f] + bend[f] * (p - center[f]).abs() + 1e-5f * (1.0f + (float)fabs(plane_d[f]) + p.abs());
+	}
+};
+
+// plane of a face by Newell's method. corners index the position arrays
+static void get_face_plane(const int* corners, int pcount, const float* x, const float* y, const float* z,
+	MQPoint& n, MQPoint& center, float& d, float& slack, float& bend)
+{
+	n.zero(); center.zero(); d = 0; slack = FLT_MAX; bend = FLT_MAX;
+	if(pcount < 3) return;
+
+	for(int i = 0; i < pcount; i++)
+	{
+		int a = corners[(i+pcount-1)%pcount], b = corners[i];
+		n.x += (y[a] - y[b]) * (z[a] + z[b]);
+		n.y += (z[a] - z[b]) * (x[a] + x[b]);
+		n.z += (x[a] - x[b]) * (y[a] + y[b]);
+		center += MQPoint(x[b],y[b],z[b]);
+	}
+	if(n.norm() == 0) return;
+	n.normalize();
+	center /= (float)pcount;
+	d = GetInnerProduct(n,center);
+
+	slack = 0;
+	bend = 0;
+	for(int i = 0; i < pcount; i++)
+	{
+		int a = corners[(i+pcount-1)%pcount], b = corners[i], c = corners[(i+1)%pcount];
+		MQPoint prev(x[a],y[a],z[a]), cur(x[b],y[b],z[b]), next(x[c],y[c],z[c]);
+		slack = max(slack,(float)fabs(GetInnerProduct(n,cur) - d));
+
+		MQPoint cn = GetCrossProduct(cur - prev, next - cur);
+		if(cn.norm() == 0) continue;
+		cn.normalize();
+		float cs = GetInnerProduct(n,cn);
+		// a concave corner turns the other way. such a face is always tested
+		if(cs <= 0) { bend = FLT_MAX; break; }
+		bend = max(bend,sqrtf(max(0.0f,1.0f - cs * cs)));
+	}
+}
+
+// project all vertices of an object. falls back to the scene when the projection could not be recovered
+static void project_vertices(MQScene scene, const ScreenProjection& projection, MQObject obj, std::vector<MQPoint>& out)
+{
+	int vcount = obj->GetVertexCount();
+	out.resize(vcount);
+	if(vcount == 0) return;
+	PROFILE_COUNT(PROFILE_VERTICES_PROJECTED,vcount);
+
+	if(!projection.IsValid())
+	{
+		for(int v = 0; v < vcount; v++) out[v] = scene->Convert3DToScreen(obj->GetVertex(v));
+		return;
+	}
+
+	std::vector<float> x(vcount), y(vcount), z(vcount);
+	for(int v = 0; v < vcount; v++)
+	{
+		MQPoint p = obj->GetVertex(v);
+		x[v] = p.x; y[v] = p.y; z[v] = p.z;
+	}
+	projection.ProjectArray(&x[0],&y[0],&z[0],vcount,&out[0]);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class WorkerTask
+{
+public:
+	virtual ~WorkerTask() {}
+	virtual void Run() = 0;
+};
+
+// persistent worker threads, one for each processor but the calling one.
+// the calling thread takes tasks too, and Run returns when all of them are done.
+// tasks must not touch the document. the SDK is not thread-safe
+class WorkerPool
+{
+public:
+	WorkerPool() { m_started = false; m_threads = 0; m_tasks = NULL; m_next = 0; m_pending = 0; m_quit = 0; m_done = NULL; }
+
+	int GetThreadCount() { start(); return m_threads + 1; }
+
+	// maxthreads 0 for all
+	void Run(std::vector<WorkerTask*>& tasks, int maxthreads = 0)
+	{
+		if(tasks.empty()) return;
+		start();
+
+		int workers = m_threads;
+		if(maxthreads > 0) workers = min(workers,maxthreads - 1);
+		workers = min(workers,(int)tasks.size() - 1);
+
+		m_tasks = &tasks;
+		m_next = 0;
+		if(workers > 0)
+		{
+			m_pending = workers;
+			ResetEvent(m_done);
+			for(int i = 0; i < workers; i++) SetEvent(m_wake[i]);
+		}
+		work();
+		if(workers > 0) WaitForSingleObject(m_done,INFINITE);
+		m_tasks = NULL;
+	}
+
+	// called on Exit. threads must not be waited for in DllMain
+	void Shutdown()
+	{
+		if(!m_started) return;
+		m_quit = 1;
+		for(int i = 0; i < m_threads; i++) SetEvent(m_wake[i]);
+		if(m_threads > 0) WaitForMultipleObjects(m_threads,&m_handles[0],TRUE,INFINITE);
+		for(int i = 0; i < m_threads; i++) { CloseHandle(m_handles[i]); CloseHandle(m_wake[i]); }
+		CloseHandle(m_done);
+		m_handles.clear(); m_wake.clear(); m_params.clear();
+		m_threads = 0;
+		m_quit = 0;
+		m_started = false;
+	}
+
+private:
+	struct ThreadParam
+	{
+		WorkerPool* pool;
+		int index;
+	};
+
+	void start()
+	{
+		if(m_started) return;
+		m_started = true;
+
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		int threads = max(1,min((int)info.dwNumberOfProcessors,32)) - 1;
+
+		m_done = CreateEvent(NULL,TRUE,FALSE,NULL);
+
+		// events are all made before any thread looks at the list
+		for(int i = 0; i < threads; i++)
+		{
+			HANDLE wake = CreateEvent(NULL,FALSE,FALSE,NULL);
+			if(wake == NULL) break;
+			m_wake.push_back(wake);
+		}
+		m_params.resize(m_wake.size());
+		for(int i = 0; i < (int)m_wake.size(); i++)
+		{
+			m_params[i].pool = this;
+			m_params[i].index = i;
+			HANDLE thread = CreateThread(NULL,0,thread_main,&m_params[i],0,NULL);
+			if(thread == NULL) break;
+			m_handles.push_back(thread);
+		}
+		m_threads = (int)m_handles.size();
+		for(int i = m_threads; i < (int)m_wake.size(); i++) CloseHandle(m_wake[i]);
+		m_wake.resize(m_threads);
+	}
+
+	static DWORD WINAPI thread_main(LPVOID param)
+	{
+		ThreadParam* p = (ThreadParam*)param;
+		WorkerPool* pool = p->pool;
+		while(1)
+		{
+			WaitForSingleObject(pool->m_wake[p->index],INFINITE);
+			if(pool->m_quit) break;
+			pool->work();
+			if(InterlockedDecrement(&pool->m_pending) == 0) SetEvent(pool->m_done);
+		}
+		return 0;
+	}
+
+	void work()
+	{
+		std::vector<WorkerTask*>& tasks = *m_tasks;
+		LONG count = (LONG)tasks.size();
+		for(LONG i = InterlockedIncrement(&m_next) - 1; i < count; i = InterlockedIncrement(&m_next) - 1) tasks[i]->Run();
+	}
+
+	bool m_started;
+	int m_threads;
+	std::vector<HANDLE> m_handles;
+	std::vector<HANDLE> m_wake;
+	std::vector<ThreadParam> m_params;
+	HANDLE m_done;
+
+	std::vector<WorkerTask*>* m_tasks;
+	volatile LONG m_next;
+	volatile LONG m_pending;
+	volatile LONG m_quit;
+};
+
+static WorkerPool s_workers;
+
+// a triangle of an editable face on the screen. id is 1 + the position of the face in the list given to VisibilityBuffer::Render
+struct RasterTriangle
+{
+	float x[3], y[3], z[3];
+	unsigned int id;
+};
+
+// which side of the edge from a to b p is on, positive to the left as in is_point_in_triangle_2d.
+// the edge is always evaluated from the same end, so the opposite edge of a neighbor gets exactly the negated value
+static inline float raster_edge(float ax, float ay, float bx, float by, float px, float py)
+{
+	if(ax < bx || (ax == bx && ay < by)) return (bx-ax) * (py-ay) - (by-ay) * (px-ax);
+	return -((ax-bx) * (py-by) - (ay-by) * (px-bx));
+}
+
+// pixels on an edge go to the one of the two triangles sharing it for which this holds, so no pixel falls between them
+static inline bool raster_owns_edge(float ax, float ay, float bx, float by)
+{
+	return (by > ay) || (by == ay && bx < ax);
+}
+
+// pixels of a tile, nearest triangle wins. the tile is cleared first, so every tile of the buffer is run
+class RasterTileTask : public WorkerTask
+{
+public:
+	RasterTileTask(const RasterTriangle* triangles, const int* bin, int count, float* depth, unsigned int* ids, int stride, int x0, int y0, int x1, int y1)
+		: m_triangles(triangles), m_bin(bin), m_count(count), m_depth(depth), m_ids(ids), m_stride(stride), m_x0(x0), m_y0(y0), m_x1(x1), m_y1(y1) {}
+
+	void Run()
+	{
+		for(int y = m_y0; y < m_y1; y++)
+		{
+			std::fill(m_depth + y * m_stride + m_x0,m_depth + y * m_stride + m_x1,FLT_MAX);
+			std::fill(m_ids + y * m_stride + m_x0,m_ids + y * m_stride + m_x1,0u);
+		}
+
+		for(int i = 0; i < m_count; i++)
+		{
+			const RasterTriangle& t = m_triangles[m_bin[i]];
+
+			// only the winding is_point_in_triangle_2d takes. pixels are sampled at integer positions as the mouse is
+			float area = (t.x[1]-t.x[0]) * (t.y[2]-t.y[0]) - (t.y[1]-t.y[0]) * (t.x[2]-t.x[0]);
+			if(!(area > 0)) continue;
+			bool own0 = raster_owns_edge(t.x[1],t.y[1],t.x[2],t.y[2]);
+			bool own1 = raster_owns_edge(t.x[2],t.y[2],t.x[0],t.y[0]);
+			bool own2 = raster_owns_edge(t.x[0],t.y[0],t.x[1],t.y[1]);
+
+			int xa = max(m_x0,(int)ceilf(min(min(t.x[0],t.x[1]),t.x[2])));
+			int xb = min(m_x1 - 1,(int)floorf(max(max(t.x[0],t.x[1]),t.x[2])));
+			int ya = max(m_y0,(int)ceilf(min(min(t.y[0],t.y[1]),t.y[2])));
+			int yb = min(m_y1 - 1,(int)floorf(max(max(t.y[0],t.y[1]),t.y[2])));
+
+			for(int y = ya; y <= yb; y++)
+			{
+				float py = (float)y;
+				for(int x = xa; x <= xb; x++)
+				{
+					float px = (float)x;
+					float w0 = raster_edge(t.x[1],t.y[1],t.x[2],t.y[2],px,py);
+					float w1 = raster_edge(t.x[2],t.y[2],t.x[0],t.y[0],px,py);
+					float w2 = raster_edge(t.x[0],t.y[0],t.x[1],t.y[1],px,py);
+					if(!(w0 > 0 || (w0 == 0 && own0)) || !(w1 > 0 || (w1 == 0 && own1)) || !(w2 > 0 || (w2 == 0 && own2))) continue;
+					if(w0 + w1 + w2 <= 0) continue;
+
+					// screen z is affine on the screen, so it is interpolated as it is
+					float z = (w0 * t.z[0] + w1 * t.z[1] + w2 * t.z[2]) / (w0 + w1 + w2);
+					int k = y * m_stride + x;
+					if(z < m_depth[k]) { m_depth[k] = z; m_ids[k] = t.id; }
+				}
+			}
+		}
+	}
+
+private:
+	const RasterTriangle* m_triangles;
+	const int* m_bin;
+	int m_count;
+	float* m_depth;
+	unsigned int* m_ids;
+	int m_stride;
+	int m_x0, m_y0, m_x1, m_y1;
+};
+
+// the editable face in front at each pixel of a view and its depth, rendered in software
+class VisibilityBuffer
+{
+public:
+	struct Face
+	{
+		int object;
+		int face;
+		const FaceTriangulation* triangulation;
+	};
+
+	VisibilityBuffer() { m_width = 0; m_height = 0; m_valid = false; }
+
+	bool IsValid() const { return m_valid; }
+	void Invalidate() { m_valid = false; m_faces.clear(); }
+
+	// triangles are binned to tiles, and the tiles are rasterized on the worker threads
+	void Render(std::vector<Face>& faces, const std::vector<RasterTriangle>& triangles, int width, int height)
+	{
+		m_valid = false;
+		m_faces.swap(faces);
+		if(width <= 0 || height <= 0) return;
+
+		m_width = width;
+		m_height = height;
+		m_depth.resize(width * height);
+		m_ids.resize(width * height);
+
+		int tx = (width + TILE - 1) / TILE, ty = (height + TILE - 1) / TILE;
+		std::vector<int> offsets(tx * ty + 1,0);
+		std::vector<int> ranges(triangles.size() * 4);
+		for(size_t i = 0; i < triangles.size(); i++)
+		{
+			const RasterTriangle& t = triangles[i];
+			float l = min(min(t.x[0],t.x[1]),t.x[2]), r = max(max(t.x[0],t.x[1]),t.x[2]);
+			float b = min(min(t.y[0],t.y[1]),t.y[2]), u = max(max(t.y[0],t.y[1]),t.y[2]);
+			int* range = &ranges[i * 4];
+			if(r < 0 || u < 0 || l >= (float)width || b >= (float)height) { range[0] = 0; range[1] = -1; range[2] = 0; range[3] = -1; continue; }
+			range[0] = (int)max(0.0f,l) / TILE; range[1] = (int)min((float)(width - 1),r) / TILE;
+			range[2] = (int)max(0.0f,b) / TILE; range[3] = (int)min((float)(height - 1),u) / TILE;
+			for(int y = range[2]; y <= range[3]; y++) for(int x = range[0]; x <= range[1]; x++) offsets[y * tx + x + 1]++;
+		}
+		for(int i = 0; i < tx * ty; i++) offsets[i+1] += offsets[i];
+
+		// triangles stay in their order in each bin, so ties in depth go to the first one
+		std::vector<int> bins(max(1,offsets[tx * ty]));
+		std::vector<int> cursor(offsets.begin(),offsets.end() - 1);
+		for(size_t i = 0; i < triangles.size(); i++)
+		{
+			const int* range = &ranges[i * 4];
+			for(int y = range[2]; y <= range[3]; y++) for(int x = range[0]; x <= range[1]; x++) bins[cursor[y * tx + x]++] = (int)i;
+		}
+
+		const RasterTriangle* tri = triangles.empty() ? NULL : &triangles[0];
+		std::vector<RasterTileTask> ttasks;
+		ttasks.reserve(tx * ty);
+		for(int y = 0; y < ty; y++)
+		for(int x = 0; x < tx; x++)
+		{
+			int i = y * tx + x;
+			ttasks.push_back(RasterTileTask(tri,&bins[0] + offsets[i],offsets[i+1] - offsets[i],&m_depth[0],&m_ids[0],width,
+				x * TILE,y * TILE,min(width,(x + 1) * TILE),min(height,(y + 1) * TILE)));
+		}
+		std::vector<WorkerTask*> tasks;
+		for(size_t i = 0; i < ttasks.size(); i++) tasks.push_back(&ttasks[i]);
+		s_workers.Run(tasks);
+
+		m_valid = true;
+	}
+
+	// the face at pixel (x, y). false when there is none or it is off the buffer
+	bool GetFace(int x, int y, int& object, int& face, float& depth) const
+	{
+		if(!m_valid || x < 0 || y < 0 || x >= m_width || y >= m_height) return false;
+		unsigned int id = m_ids[y * m_width + x];
+		if(id == 0) return false;
+		object = m_faces[id-1].object;
+		face = m_faces[id-1].face;
+		depth = m_depth[y * m_width + x];
+		return true;
+	}
+
+	// whether a point of object with screen depth p.z is hidden by nothing at the pixels around it.
+	// a pixel of a face having all of the vertices is the point itself, whatever depth it has there
+	bool IsVisible(const MQPoint& p, int object, const int* vertices, int count) const
+	{
+		if(!m_valid || p.z < 0) return true;
+		int x0 = (int)floorf(p.x), y0 = (int)floorf(p.y);
+		float tolerance = 1e-5f * (1.0f + (float)fabs(p.z));
+		for(int y = y0; y <= y0 + 1; y++)
+		for(int x = x0; x <= x0 + 1; x++)
+		{
+			if(x < 0 || y < 0 || x >= m_width || y >= m_height) return true;
+			int k = y * m_width + x;
+			if(m_ids[k] == 0 || p.z <= m_depth[k] + tolerance) return true;
+
+			const Face& f = m_faces[m_ids[k]-1];
+			if(f.object != object || f.face >= f.triangulation->GetFaceCount()) continue;
+			const int* corners = f.triangulation->GetCorners(f.face);
+			int pcount = f.triangulation->GetCornerCount(f.face);
+			int found = 0;
+			for(int i = 0; i < count; i++) if(std::find(corners,corners + pcount,vertices[i]) != corners + pcount) found++;
+			if(found == count) return true;
+		}
+		return false;
+	}
+
+private:
+	enum { TILE = 64 };
+
+	bool m_valid;
+	int m_width, m_height;
+	std::vector<float> m_depth;
+	std::vector<unsigned int> m_ids;
+	std::vector<Face> m_faces;
+};
+
+// rows [begin, end) of a polygon mask. a pixel is inside when its integer position is, by the even-odd rule
+class MaskRowTask : public WorkerTask
+{
+public:
+	MaskRowTask(const MQPoint* polygon, int count, unsigned char* mask, int x0, int y0, int width, int begin, int end)
+		: m_polygon(polygon), m_count(count), m_mask(mask), m_x0(x0), m_y0(y0), m_width(width), m_begin(begin), m_end(end) {}
+
+	void Run()
+	{
+		// only edges crossing these rows are looked at
+		float top = (float)(m_y0 + m_begin), bottom = (float)(m_y0 + m_end);
+		std::vector<int> edges;
+		for(int i = 0; i < m_count; i++)
+		{
+			const MQPoint& a = m_polygon[i];
+			const MQPoint& b = m_polygon[(i + 1) % m_count];
+			if(a.y == b.y || max(a.y,b.y) < top || min(a.y,b.y) >= bottom) continue;
+			edges.push_back(i);
+		}
+
+		std::vector<float> crossings;
+		for(int row = m_begin; row < m_end; row++)
+		{
+			unsigned char* line = m_mask + row * m_width;
+			std::fill(line,line + m_width,(unsigned char)0);
+
+			// half open in y, so a vertex on the row is counted once
+			float y = (float)(m_y0 + row);
+			crossings.clear();
+			for(size_t k = 0; k < edges.size(); k++)
+			{
+				const MQPoint& a = m_polygon[edges[k]];
+				const MQPoint& b = m_polygon[(edges[k] + 1) % m_count];
+				if((a.y <= y && y < b.y) || (b.y <= y && y < a.y)) crossings.push_back(a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y));
+			}
+			std::sort(crossings.begin(),crossings.end());
+
+			for(size_t k = 0; k + 1 < crossings.size(); k += 2)
+			{
+				int xa = max(0,(int)ceilf(crossings[k]) - m_x0);
+				int xb = min(m_width,(int)ceilf(crossings[k+1]) - m_x0);
+				if(xa < xb) std::fill(line + xa,line + xb,(unsigned char)1);
+			}
+		}
+	}
+
+private:
+	const MQPoint* m_polygon;
+	int m_count;
+	unsigned char* m_mask;
+	int m_x0, m_y0, m_width;
+	int m_begin, m_end;
+};
+
+// inside of a closed polygon on the screen, a byte for each pixel of its bounding box. 
+// a point is tested by a single lookup at the pixel nearest to it. loops wound twice are left out
+class ScreenMask
+{
+public:
+	ScreenMask() { Clear(); }
+
+	void Clear() { m_x0 = 0; m_y0 = 0; m_width = 0; m_height = 0; }
+	bool IsEmpty() const { return m_width == 0 || m_height == 0; }
+
+	// bounds of the points which can be inside, in the order regional_select has them
+	void GetBounds(float& l, float& r, float& b, float& t) const
+	{
+		l = (float)m_x0 - 0.5f; r = (float)(m_x0 + m_width) - 0.5f;
+		b = (float)m_y0 - 0.5f; t = (float)(m_y0 + m_height) - 0.5f;
+	}
+
+	bool Contains(const MQPoint& p) const
+	{
+		int x = (int)floorf(p.x + 0.5f) - m_x0, y = (int)floorf(p.y + 0.5f) - m_y0;
+		if(x < 0 || y < 0 || x >= m_width || y >= m_height) return false;
+		return m_mask[y * m_width + x] != 0;
+	}
+
+	// bands of rows are filled on the worker threads
+	void Rasterize(const std::vector<MQPoint>& polygon)
+	{
+		Clear();
+		if(polygon.size() < 3) return;
+
+		float l = FLT_MAX, r = -FLT_MAX, b = FLT_MAX, t = -FLT_MAX;
+		for(size_t i = 0; i < polygon.size(); i++)
+		{
+			l = min(l,polygon[i].x); r = max(r,polygon[i].x);
+			b = min(b,polygon[i].y); t = max(t,polygon[i].y);
+		}
+		m_x0 = (int)ceilf(l); m_y0 = (int)ceilf(b);
+		m_width = max(0,(int)floorf(r) - m_x0 + 1);
+		m_height = max(0,(int)floorf(t) - m_y0 + 1);
+		if(IsEmpty()) return;
+		m_mask.resize(m_width * m_height);
+
+		const int band = 16;
+		std::vector<MaskRowTask> rtasks;
+		for(int begin = 0; begin < m_height; begin += band)
+		{
+			rtasks.push_back(MaskRowTask(&polygon[0],(int)polygon.size(),&m_mask[0],m_x0,m_y0,m_width,begin,min(begin + band,m_height)));
+		}
+		std::vector<WorkerTask*> tasks;
+		for(size_t i = 0; i < rtasks.size(); i++) tasks.push_back(&rtasks[i]);
+		s_workers.Run(tasks);
+	}
+
+private:
+	int m_x0, m_y0;
+	int m_width, m_height;
+	std::vector<unsigned char> m_mask;
+};
+
+// what region selection finds in an object. filled by tasks, applied to the document afterwards.
+// masks have a bit for each vertex or edge, 32 in a word, so tasks starting at multiples of 32 never share a word
+struct RegionSelectJob
+{
+	int object;
+	const std::vector<MQPoint>* screen;
+	const VertexFaceAdjacency* adjacency;
+	const FaceEdgeTable* edges;
+	const VisibilityBuffer* visibility;		// hidden vertices are left out. NULL to select through
+	const ScreenMask* mask;					// lasso or polygon in the rectangle. NULL for the rectangle itself
+
+	std::vector<unsigned int> inside;		// for each vertex
+	std::vector<unsigned int> edge_inside;	// for each edge of the edge table
+};
+
+// vertices of [begin, end) of an object inside the rectangle, and in the mask if there is one. 
+// unreferred vertices are left out, and hidden ones when asked
+class RegionVertexTask : public WorkerTask
+{
+public:
+	RegionVertexTask(RegionSelectJob* job, int begin, int end, float l, float r, float b, float t)
+		: m_job(job), m_begin(begin), m_end(end), m_l(l), m_r(r), m_b(b), m_t(t) {}
+
+	void Run()
+	{
+		const std::vector<MQPoint>& screen = *m_job->screen;
+#ifdef EXMOVE_USE_SSE
+		const __m128 l = _mm_set1_ps(m_l), r = _mm_set1_ps(m_r), b = _mm_set1_ps(m_b), t = _mm_set1_ps(m_t);
+#endif
+		for(int v0 = m_begin; v0 < m_end; v0 += 32)
+		{
+			int n = min(32,m_end - v0);
+			unsigned int bits = 0;
+			int k = 0;
+#ifdef EXMOVE_USE_SSE
+			// four points are twelve floats in a row. x and y are gathered from them by shuffles
+			for(; k + 4 <= n; k += 4)
+			{
+				const float* f = &screen[v0 + k].x;
+				__m128 p0 = _mm_loadu_ps(f);		// x0 y0 z0 x1
+				__m128 p1 = _mm_loadu_ps(f + 4);	// y1 z1 x2 y2
+				__m128 p2 = _mm_loadu_ps(f + 8);	// z2 x3 y3 z3
+				__m128 x = _mm_shuffle_ps(p0,_mm_shuffle_ps(p1,p2,_MM_SHUFFLE(1,1,2,2)),_MM_SHUFFLE(2,0,3,0));
+				__m128 y = _mm_shuffle_ps(_mm_shuffle_ps(p0,p1,_MM_SHUFFLE(0,0,1,1)),_mm_shuffle_ps(p1,p2,_MM_SHUFFLE(2,2,3,3)),_MM_SHUFFLE(2,0,2,0));
+				__m128 in = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(l,x),_mm_cmple_ps(x,r)),_mm_and_ps(_mm_cmple_ps(b,y),_mm_cmple_ps(y,t)));
+				bits |= (unsigned int)_mm_movemask_ps(in) << k;
+			}
+#endif
+			for(; k < n; k++)
+			{
+				const MQPoint& p = screen[v0 + k];
+				if(m_l <= p.x && p.x <= m_r && m_b <= p.y && p.y <= m_t) bits |= 1u << k;
+			}
+
+			if(bits != 0)
+			{
+				for(k = 0; k < n; k++)
+				{
+					if(((bits >> k) & 1) == 0) continue;
+					int v = v0 + k;
+					if(m_job->adjacency->GetFaceCount(v) == 0) bits &= ~(1u << k);
+					else if(m_job->mask != NULL && !m_job->mask->Contains(screen[v])) bits &= ~(1u << k);
+					else if(m_job->visibility != NULL && !m_job->visibility->IsVisible(screen[v],m_job->object,&v,1)) bits &= ~(1u << k);
+				}
+			}
+			m_job->inside[v0 >> 5] = bits;
+		}
+	}
+
+private:
+	RegionSelectJob* m_job;
+	int m_begin, m_end;
+	float m_l, m_r, m_b, m_t;
+};
+
+// edges of [begin, end) of an object whose both ends are inside. no branch but the bounds
+class RegionEdgeTask : public WorkerTask
+{
+public:
+	RegionEdgeTask(RegionSelectJob* job, int begin, int end) : m_job(job), m_begin(begin), m_end(end) {}
+
+	void Run()
+	{
+		const int* first = m_job->edges->GetFirstVertices();
+		const int* second = m_job->edges->GetSecondVertices();
+		const unsigned int* inside = &m_job->inside[0];
+		unsigned int vcount = (unsigned int)m_job->screen->size();
+		for(int e0 = m_begin; e0 < m_end; e0 += 32)
+		{
+			int n = min(32,m_end - e0);
+			unsigned int bits = 0;
+			for(int k = 0; k < n; k++)
+			{
+				unsigned int a = (unsigned int)first[e0 + k], b = (unsigned int)second[e0 + k];
+				unsigned int ia = a < vcount ? inside[a >> 5] >> (a & 31) : 0;
+				unsigned int ib = b < vcount ? inside[b >> 5] >> (b & 31) : 0;
+				bits |= (ia & ib & 1u) << k;
+			}
+			m_job->edge_inside[e0 >> 5] = bits;
+		}
+	}
+
+private:
+	RegionSelectJob* m_job;
+	int m_begin, m_end;
+};
+
+// buffers refresh_cache fills for an object. kept to be reused by the next refresh
+struct ViewRefreshBuffers
+{
+	std::vector<BOOL> visible;				// for each face, as GetVisibleFace tells
+	std::vector<float> x, y, z;				// vertex positions
+	std::vector<unsigned char> referred;	// for each vertex, by an editable face
+};
+
+// what refresh_cache works out for an object. everything is read from the document before tasks run
+struct ObjectCache;
+struct ViewRefreshJob
+{
+	ObjectCache* cache;
+	MQObject obj;
+	ViewRefreshBuffers* buffers;
+	FaceFacingCache* facing;
+	const FaceTriangulation* faces;
+	const ScreenProjection* projection;
+	std::vector<MQPoint>* screen;
+	MQPoint eye;
+	bool full;		// planes are made again and every face is tested
+};
+
+// face planes of [begin, end) of an object, or the faces which may have turned over since the last refresh
+class FacingTask : public WorkerTask
+{
+public:
+	FacingTask(ViewRefreshJob* job, int begin, int end) : m_job(job), m_begin(begin), m_end(end) {}
+
+	void Run()
+	{
+		FaceFacingCache& cache = *m_job->facing;
+		const ViewRefreshBuffers& buffers = *m_job->buffers;
+		const float* x = buffers.x.empty() ? NULL : &buffers.x[0];
+		const float* y = buffers.y.empty() ? NULL : &buffers.y[0];
+		const float* z = buffers.z.empty() ? NULL : &buffers.z[0];
+		const MQPoint& eye = m_job->eye;
+		for(int f = m_begin; f < m_end; f++)
+		{
+			if(m_job->full)
+			{
+				get_face_plane(m_job->faces->GetCorners(f),m_job->faces->GetCornerCount(f),x,y,z,cache.normal[f],cache.center[f],cache.plane_d[f],cache.slack[f],cache.bend[f]);
+				cache.dist[f] = GetInnerProduct(cache.normal[f],eye) - cache.plane_d[f];
+				continue;
+			}
+
+			// a face can turn over only when the eye crosses its plane
+			float s1 = GetInnerProduct(cache.normal[f],eye) - cache.plane_d[f];
+			float s0 = cache.dist[f];
+			cache.dist[f] = s1;
+			float tol0 = cache.GetTolerance(f,cache.eye);
+			float tol1 = cache.GetTolerance(f,eye);
+			if((s0 > tol0 && s1 > tol1) || (s0 < -tol0 && s1 < -tol1)) continue;
+			retest.push_back(f);
+		}
+	}
+
+	// faces near the silhouette. IsFrontFace decides them on the calling thread
+	std::vector<int> retest;
+
+	ViewRefreshJob* GetJob() const { return m_job; }
+
+private:
+	ViewRefreshJob* m_job;
+	int m_begin, m_end;
+};
+
+// screen positions of vertices [begin, end) of an object
+class ProjectTask : public WorkerTask
+{
+public:
+	ProjectTask(ViewRefreshJob* job, int begin, int end) : m_job(job), m_begin(begin), m_end(end) {}
+
+	void Run()
+	{
+		const ViewRefreshBuffers& buffers = *m_job->buffers;
+		m_job->projection->ProjectArray(&buffers.x[m_begin],&buffers.y[m_begin],&buffers.z[m_begin],m_end - m_begin,&(*m_job->screen)[m_begin]);
+	}
+
+private:
+	ViewRefreshJob* m_job;
+	int m_begin, m_end;
+};
+
+// out[i] = s[i] + k * w[i] * n[i]. n may be NULL for 1
+static void scale_add(const float* src, const float* w, const float* n, float k, float* out, int count)
+{
+	int i = 0;
+#ifdef EXMOVE_USE_SSE
+	__m128 kk = _mm_set1_ps(k);
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128 d = _mm_mul_ps(kk,_mm_loadu_ps(w + i));
+		if(n != NULL) d = _mm_mul_ps(d,_mm_loadu_ps(n + i));
+		_mm_storeu_ps(out + i,_mm_add_ps(_mm_loadu_ps(src + i),d));
+	}
+#endif
+	for(; i < count; i++) out[i] = src[i] + k * w[i] * (n != NULL ? n[i] : 1.0f);
+}
+
+// a vertex taken along by soft selection, with the falloff weights from the selection and from the symmetry
+struct FalloffVertex
+{
+	MQSelectVertex vertex;
+	float selection;
+	float symmetry;
+};
+
+// vertices moved by a drag, with their positions at the start of it in contiguous arrays.
+// every move is computed from the start, so nothing drifts however many events come.
+// a vertex both in the selection and in the symmetry (or twice in the symmetry) moves once for each.
+// soft selected vertices move by their weights, in the same passes
+class DragSession
+{
+public:
+	DragSession() { m_has_normals = false; }
+
+	void Clear()
+	{
+		m_vertices.clear(); m_groups.clear();
+		m_x.clear(); m_y.clear(); m_z.clear();
+		m_nx.clear(); m_ny.clear(); m_nz.clear();
+		m_ox.clear(); m_oy.clear(); m_oz.clear();
+		m_wmirror.clear(); m_wall.clear();
+		m_has_normals = false;
+	}
+
+	bool IsEmpty() const { return m_vertices.empty(); }
+	int GetCount() const { return (int)m_vertices.size(); }
+	const MQSelectVertex& GetVertex(int i) const { return m_vertices[i]; }
+
+	// falloff vertices are neither in the selection nor in the symmetry
+	void Begin(MQDocument doc, const std::vector<MQSelectVertex>& selection, const std::vector<MQSelectVertex>& symmetry, const std::vector<FalloffVertex>* falloff = NULL)
+	{
+		Clear();
+
+		// (vertex, 0 for selection / 1 for symmetry / 2 + index in falloff), sorted to group them by object
+		size_t fcount = (falloff != NULL) ? falloff->size() : 0;
+		std::vector< std::pair<MQSelectVertex,int> > entries;
+		entries.reserve(selection.size() + symmetry.size() + fcount);
+		for(size_t i = 0; i < selection.size(); i++) entries.push_back(std::pair<MQSelectVertex,int>(selection[i],0));
+		for(size_t i = 0; i < symmetry.size(); i++) entries.push_back(std::pair<MQSelectVertex,int>(symmetry[i],1));
+		for(size_t i = 0; i < fcount; i++) entries.push_back(std::pair<MQSelectVertex,int>((*falloff)[i].vertex,2 + (int)i));
+		std::sort(entries.begin(),entries.end(),EntryLess());
+
+		for(size_t i = 0; i < entries.size(); i++)
+		{
+			const MQSelectVertex& sv = entries[i].first;
+			bool same = !m_vertices.empty() && m_vertices.back().object == sv.object && m_vertices.back().vertex == sv.vertex;
+			if(!same)
+			{
+				if(m_vertices.empty() || m_vertices.back().object != sv.object) m_groups.push_back((int)m_vertices.size());
+				m_vertices.push_back(sv);
+				m_wmirror.push_back(0);
+				m_wall.push_back(0);
+			}
+			if(entries[i].second >= 2)
+			{
+				const FalloffVertex& fv = (*falloff)[entries[i].second - 2];
+				m_wmirror.back() += fv.selection - fv.symmetry;
+				m_wall.back() += fv.selection + fv.symmetry;
+				continue;
+			}
+			// mirrored moves go opposite in x
+			m_wmirror.back() += (entries[i].second == 0) ? 1.0f : -1.0f;
+			m_wall.back() += 1.0f;
+		}
+		m_groups.push_back((int)m_vertices.size());
+
+		Rebase(doc);
+	}
+
+	// current positions become the start
+	void Rebase(MQDocument doc)
+	{
+		int count = GetCount();
+		m_x.resize(count); m_y.resize(count); m_z.resize(count);
+		for(size_t g = 0; g + 1 < m_groups.size(); g++)
+		{
+			MQObject obj = doc->GetObject(m_vertices[m_groups[g]].object);
+			if(obj == NULL) continue;
+			for(int i = m_groups[g]; i < m_groups[g+1]; i++)
+			{
+				MQPoint p = obj->GetVertex(m_vertices[i].vertex);
+				m_x[i] = p.x; m_y[i] = p.y; m_z[i] = p.z;
+			}
+		}
+	}
+
+	bool HasNormals() const { return m_has_normals; }
+
+	// runs of vertices of the same object
+	int GetGroupCount() const { return m_groups.empty() ? 0 : (int)m_groups.size() - 1; }
+	int GetGroupObject(int g) const { return m_vertices[m_groups[g]].object; }
+	int GetGroupBegin(int g) const { return m_groups[g]; }
+
+	// box around where the last move put the vertices of a group
+	bool GetMovedBounds(int g, MQPoint& bmin, MQPoint& bmax) const
+	{
+		if(m_ox.empty()) return false;
+		bmin = bmax = MQPoint(m_ox[m_groups[g]],m_oy[m_groups[g]],m_oz[m_groups[g]]);
+		for(int i = m_groups[g] + 1; i < m_groups[g+1]; i++)
+		{
+			bmin.x = min(bmin.x,m_ox[i]); bmin.y = min(bmin.y,m_oy[i]); bmin.z = min(bmin.z,m_oz[i]);
+			bmax.x = max(bmax.x,m_ox[i]); bmax.y = max(bmax.y,m_oy[i]); bmax.z = max(bmax.z,m_oz[i]);
+		}
+		return true;
+	}
+
+	void SetNormals(const std::vector<MQPoint>& normals)
+	{
+		int count = GetCount();
+		m_nx.resize(count); m_ny.resize(count); m_nz.resize(count);
+		for(int i = 0; i < count; i++) { m_nx[i] = normals[i].x; m_ny[i] = normals[i].y; m_nz[i] = normals[i].z; }
+		m_has_normals = true;
+	}
+
+	// the selection moves by offset, the symmetry by offset mirrored in x
+	void Translate(MQDocument doc, const MQPoint& offset)
+	{
+		int count = GetCount();
+		if(count == 0) return;
+		m_ox.resize(count); m_oy.resize(count); m_oz.resize(count);
+		scale_add(&m_x[0],&m_wmirror[0],NULL,offset.x,&m_ox[0],count);
+		scale_add(&m_y[0],&m_wall[0],NULL,offset.y,&m_oy[0],count);
+		scale_add(&m_z[0],&m_wall[0],NULL,offset.z,&m_oz[0],count);
+		write_back(doc);
+	}
+
+	// every vertex moves along its own normal
+	void MoveAlongNormals(MQDocument doc, float dist)
+	{
+		int count = GetCount();
+		if(count == 0 || !m_has_normals) return;
+		m_ox.resize(count); m_oy.resize(count); m_oz.resize(count);
+		scale_add(&m_x[0],&m_wall[0],&m_nx[0],dist,&m_ox[0],count);
+		scale_add(&m_y[0],&m_wall[0],&m_ny[0],dist,&m_oy[0],count);
+		scale_add(&m_z[0],&m_wall[0],&m_nz[0],dist,&m_oz[0],count);
+		write_back(doc);
+	}
+
+private:
+	struct EntryLess
+	{
+		bool operator()(const std::pair<MQSelectVertex,int>& a, const std::pair<MQSelectVertex,int>& b) const
+		{
+			if(a.first.object != b.first.object) return a.first.object < b.first.object;
+			if(a.first.vertex != b.first.vertex) return a.first.vertex < b.first.vertex;
+			return a.second < b.second;
+		}
+	};
+
+	// an object is fetched once for each run of its vertices
+	void write_back(MQDocument doc)
+	{
+		for(size_t g = 0; g + 1 < m_groups.size(); g++)
+		{
+			MQObject obj = doc->GetObject(m_vertices[m_groups[g]].object);
+			if(obj == NULL) continue;
+			for(int i = m_groups[g]; i < m_groups[g+1]; i++) obj->SetVertex(m_vertices[i].vertex,MQPoint(m_ox[i],m_oy[i],m_oz[i]));
+		}
+	}
+
+	std::vector<MQSelectVertex> m_vertices;
+	std::vector<int> m_groups;	// first index of each object's run, and the end
+
+	std::vector<float> m_x, m_y, m_z;
+	std::vector<float> m_nx, m_ny, m_nz;
+	std::vector<float> m_wmirror;	// times in the selection minus times in the symmetry. falloff weights for soft ones
+	std::vector<float> m_wall;		// times in either
+	bool m_has_normals;
+
+	std::vector<float> m_ox, m_oy, m_oz;
+};
+
+// world space box around all vertices of an object. it only grows while vertices are dragged
+struct ObjectBounds
+{
+	ObjectBounds() { valid = false; }
+
+	void Build(MQObject obj)
+	{
+		valid = false;
+		int vcount = obj->GetVertexCount();
+		for(int v = 0; v < vcount; v++) Grow(obj->GetVertex(v));
+	}
+
+	void Grow(const MQPoint& p)
+	{
+		if(!valid) { bmin = bmax = p; valid = true; return; }
+		bmin.x = min(bmin.x,p.x); bmin.y = min(bmin.y,p.y); bmin.z = min(bmin.z,p.z);
+		bmax.x = max(bmax.x,p.x); bmax.y = max(bmax.y,p.y); bmax.z = max(bmax.z,p.z);
+	}
+
+	bool valid;	// false for no vertex, too
+	MQPoint bmin, bmax;
+};
+
+// how face normals are put together into a vertex normal
+enum NormalWeighting {
+	NORMAL_WEIGHT_EQUAL = 0,
+	NORMAL_WEIGHT_AREA = 1,
+	NORMAL_WEIGHT_ANGLE = 2
+};
+
+// what region selection is drawn with
+enum RegionShape {
+	REGION_RECTANGLE = 0,
+	REGION_LASSO = 1,		// freehand while the button is held
+	REGION_POLYGON = 2		// a corner for each click, closed on the first corner or by the right button
+};
+
+// which vertices around the selection a drag takes along
+enum SoftSelection {
+	SOFT_SELECTION_OFF = 0,
+	SOFT_SELECTION_SPATIAL = 1,		// within the radius in world space
+	SOFT_SELECTION_GEODESIC = 2		// within the radius along edges
+};
+
+// how the weight of a soft selected vertex goes down to 0 at the radius
+enum SoftFalloff {
+	SOFT_FALLOFF_SMOOTH = 0,
+	SOFT_FALLOFF_LINEAR = 1
+};
+
+// unit normals and areas of the faces of an object. dirty faces are computed again when they are asked
+class FaceNormalCache
+{
+public:
+	void Clear() { m_normals.clear(); m_areas.clear(); m_dirty.clear(); }
+
+	// faces added since are dirty
+	void Resize(int fcount)
+	{
+		m_normals.resize(fcount,MQPoint(0,0,0));
+		m_areas.resize(fcount,0.0f);
+		m_dirty.resize(fcount,1);
+	}
+
+	void MarkDirty(int f) { if(f < (int)m_dirty.size()) m_dirty[f] = 1; }
+
+	void MarkVertexDirty(const VertexFaceAdjacency& adjacency, int v)
+	{
+		if(v >= adjacency.GetVertexCount()) return;
+		const int* faces = adjacency.GetFaces(v);
+		for(int i = 0; i < adjacency.GetFaceCount(v); i++) MarkDirty(faces[i]);
+	}
+
+	// zero for faces with less than 3 points
+	const MQPoint& GetNormal(MQObject obj, int f) { if(m_dirty[f]) refresh(obj,f); return m_normals[f]; }
+	float GetArea(MQObject obj, int f) { if(m_dirty[f]) refresh(obj,f); return m_areas[f]; }
+
+private:
+	void refresh(MQObject obj, int f)
+	{
+		m_dirty[f] = 0;
+		m_normals[f] = MQPoint(0,0,0);
+		m_areas[f] = 0;
+
+		int pcount = obj->GetFacePointCount(f);
+		if(pcount < 3) return;
+		m_corners.resize(pcount);
+		obj->GetFacePointArray(f,&m_corners[0]);
+		const int* c = &m_corners[0];
+
+		MQPoint n;
+		if(pcount == 3)
+		{
+			MQPoint p0 = obj->GetVertex(c[0]), p1 = obj->GetVertex(c[1]), p2 = obj->GetVertex(c[2]);
+			n = ::GetNormal(p0,p1,p2);
+			m_areas[f] = GetCrossProduct(p1 - p0,p2 - p0).abs() * 0.5f;
+		}
+		else if(pcount == 4)
+		{
+			MQPoint p0 = obj->GetVertex(c[0]), p1 = obj->GetVertex(c[1]), p2 = obj->GetVertex(c[2]), p3 = obj->GetVertex(c[3]);
+			n = GetQuadNormal(p0,p1,p2,p3);
+			m_areas[f] = GetCrossProduct(p2 - p0,p3 - p1).abs() * 0.5f;
+		}
+		else
+		{
+			// Newell's method
+			MQPoint sum(0,0,0);
+			for(int i = 0; i < pcount; i++)
+			{
+				MQPoint a = obj->GetVertex(c[i]), b = obj->GetVertex(c[(i+1)%pcount]);
+				sum.x += (a.y - b.y) * (a.z + b.z);
+				sum.y += (a.z - b.z) * (a.x + b.x);
+				sum.z += (a.x - b.x) * (a.y + b.y);
+			}
+			n = sum;
+			m_areas[f] = sum.abs() * 0.5f;
+		}
+		n.normalize();
+		m_normals[f] = n;
+	}
+
+	std::vector<MQPoint> m_normals;
+	std::vector<float> m_areas;
+	std::vector<unsigned char> m_dirty;
+	std::vector<int> m_corners;
+};
+
+// unit normals taken so far for a vertex, hashed by direction.
+// the opposite of one (inner product below -0.999) is less than 0.045 away from its negation, so in one of 27 cells around it
+class OppositeNormalSet
+{
+public:
+	void Reset(int count)
+	{
+		unsigned int size = 16;
+		while(size < (unsigned int)count * 2) size <<= 1;
+		m_mask = size - 1;
+		m_head.assign(size,-1);
+		m_next.clear();
+		m_normals.clear();
+	}
+
+	bool HasOpposite(const MQPoint& n) const
+	{
+		int x = cell_coord(-n.x), y = cell_coord(-n.y), z = cell_coord(-n.z);
+		for(int dx = -1; dx <= 1; dx++)
+		for(int dy = -1; dy <= 1; dy++)
+		for(int dz = -1; dz <= 1; dz++)
+		{
+			for(int i = m_head[hash_cell(x + dx,y + dy,z + dz)]; i != -1; i = m_next[i])
+			{
+				if(GetInnerProduct(n,m_normals[i]) < -0.999f) return true;
+			}
+		}
+		return false;
+	}
+
+	void Insert(const MQPoint& n)
+	{
+		unsigned int h = hash_cell(cell_coord(n.x),cell_coord(n.y),cell_coord(n.z));
+		m_next.push_back(m_head[h]);
+		m_head[h] = (int)m_normals.size();
+		m_normals.push_back(n);
+	}
+
+private:
+	static int cell_coord(float f) { return (int)floorf(f * 20.0f); }
+
+	unsigned int hash_cell(int x, int y, int z) const
+	{
+		return (((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u) ^ ((unsigned int)z * 83492791u)) & m_mask;
+	}
+
+	unsigned int m_mask;
+	std::vector<int> m_head;
+	std::vector<int> m_next;
+	std::vector<MQPoint> m_normals;
+};
+
+// candidates for picking gathered around a cursor position, with PICK_WINDOW_MARGIN more than the thresholds.
+// while the cursor stays within the margin nothing else can be picked, so only they are tested again
+struct PickWindow
+{
+	struct Candidates
+	{
+		int object;
+		std::vector<int> vertices;
+		std::vector<MQPoint> points;	// where the vertices are on the screen
+		std::vector<int> faces;			// editable ones, in ascending order
+	};
+
+	PickWindow() { Reset(); }
+
+	void Reset()
+	{
+		valid = false;
+		objects.clear();
+	}
+
+	void Set(const MQPoint& p, const MQCommandPlugin::EDIT_OPTION& option)
+	{
+		Reset();
+		valid = true;
+		anchor = p;
+		vertex = option.EditVertex != FALSE;
+		line = option.EditLine != FALSE;
+		face = option.EditFace != FALSE;
+		current_only = option.CurrentObjectOnly != FALSE;
+	}
+
+	bool Covers(const MQPoint& p, const MQCommandPlugin::EDIT_OPTION& option) const
+	{
+		if(!valid) return false;
+		if(vertex != (option.EditVertex != FALSE) || line != (option.EditLine != FALSE) || face != (option.EditFace != FALSE)) return false;
+		if(current_only != (option.CurrentObjectOnly != FALSE)) return false;
+		float dx = p.x - anchor.x, dy = p.y - anchor.y;
+		return dx * dx + dy * dy <= PICK_WINDOW_MARGIN * PICK_WINDOW_MARGIN;
+	}
+
+	bool valid;
+	MQPoint anchor;
+	bool vertex, line, face, current_only;
+
+	// in the order objects are enumerated
+	std::vector<Candidates> objects;
+};
+
+// highlight of a scene kept between redraws. made again when the element, the view or its vertices change
+struct HighlightGeometry
+{
+	HighlightGeometry() { view_key = 0; object_id = 0; topology_version = 0; vertex_version = 0; }
+
+	MQSelectElement element;
+	unsigned int view_key;
+	UINT object_id;
+	unsigned int topology_version;	// of the object cache, when this was made
+	unsigned int vertex_version;
+	std::vector<int> indices;		// vertices of the object in drawing order
+	std::vector<MQPoint> points;	// brought onto the near plane
+	std::vector<int> triangles;		// of a face, positions in indices
+};
+
+// everything kept for an object. found by its unique ID, so it stays with the object when others are added, deleted or reordered
+struct ObjectCache
+{
+	ObjectCache() { seen = 0; view_stamp = 0; topology_built = false; vertex_version = 0; position_hash = 0; position_topology = 0; }
+
+	unsigned int seen;			// generation of the last sweep which found the object in the document
+	unsigned int view_stamp;	// view the screen state was made for. 0 for none
+
+	// topology
+	bool topology_built;
+	TopologySignature topology;
+	FaceEdgeTable edges;
+	VertexFaceAdjacency adjacency;
+	FaceBVH bvh;
+	FaceTriangulation triangulation;
+
+	// the version goes on counting, so that nothing built before can match again
+	void ClearTopology()
+	{
+		unsigned int version = topology.version;
+		topology_built = false;
+		topology = TopologySignature();
+		topology.version = version + 1;
+		edges.Clear();
+		adjacency.Clear();
+		bvh.Clear();
+		triangulation.Clear();
+	}
+
+	// vertex positions
+	unsigned int vertex_version;	// counted up whenever vertices may have been moved
+	unsigned int position_hash;		// of the positions found by the last modification, and the topology version then
+	unsigned int position_topology;
+	VertexSpatialGrid spatial;
+	VertexSpatialGrid falloff;	// cells as large as the soft selection radius
+	ObjectBounds bounds;
+	FaceNormalCache normals;
+
+	// screen state of the current view
+	FaceFacingCache facing;
+	ViewRefreshBuffers view_buffers;
+	std::vector<int> editable_faces;
+	std::vector<int> editable_vertices;
+	std::vector<MQPoint> screen_positions;
+	ScreenPointGrid screen_vertices;
+};
+
+// object caches by unique ID, in open addressing. a cache stays at the same address until it is swept away
+class ObjectCacheTable
+{
+public:
+	ObjectCacheTable() { m_count = 0; m_generation = 0; }
+	~ObjectCacheTable() { Clear(); }
+
+	void Clear()
+	{
+		for(size_t i = 0; i < m_slots.size(); i++) delete m_slots[i].cache;
+		m_slots.clear();
+		m_count = 0;
+	}
+
+	ObjectCache* Find(UINT id) const
+	{
+		if(m_slots.empty()) return NULL;
+		unsigned int mask = (unsigned int)m_slots.size() - 1;
+		for(unsigned int i = hash(id) & mask; m_slots[i].cache != NULL; i = (i + 1) & mask)
+		{
+			if(m_slots[i].id == id) return m_slots[i].cache;
+		}
+		return NULL;
+	}
+
+	// made when it is not there
+	ObjectCache& Get(UINT id)
+	{
+		ObjectCache* cache = Find(id);
+		if(cache != NULL) return *cache;
+
+		if((m_count + 1) * 2 > (int)m_slots.size()) grow();
+		cache = new ObjectCache();
+		cache->seen = m_generation;
+		insert(id,cache);
+		return *cache;
+	}
+
+	// slots in no particular order. empty ones are NULL
+	int GetSlotCount() const { return (int)m_slots.size(); }
+	ObjectCache* GetSlot(int i) const { return m_slots[i].cache; }
+
+	// objects found in the document are marked with the generation of BeginSweep, then EndSweep deletes the others
+	void BeginSweep() { m_generation++; }
+	void Mark(UINT id) { Get(id).seen = m_generation; }
+	void EndSweep()
+	{
+		std::vector<Slot> slots;
+		slots.swap(m_slots);
+		m_slots.resize(slots.size());
+		m_count = 0;
+		for(size_t i = 0; i < slots.size(); i++)
+		{
+			if(slots[i].cache == NULL) continue;
+			if(slots[i].cache->seen != m_generation) delete slots[i].cache;
+			else insert(slots[i].id,slots[i].cache);
+		}
+	}
+
+private:
+	struct Slot
+	{
+		Slot() { id = 0; cache = NULL; }
+		UINT id;
+		ObjectCache* cache;
+	};
+
+	static unsigned int hash(UINT id) { unsigned int h = (unsigned int)id * 0x9E3779B1u; return h ^ (h >> 16); }
+
+	void insert(UINT id, ObjectCache* cache)
+	{
+		unsigned int mask = (unsigned int)m_slots.size() - 1;
+		unsigned int i = hash(id) & mask;
+		while(m_slots[i].cache != NULL) i = (i + 1) & mask;
+		m_slots[i].id = id;
+		m_slots[i].cache = cache;
+		m_count++;
+	}
+
+	void grow()
+	{
+		std::vector<Slot> slots;
+		slots.swap(m_slots);
+		m_slots.resize(slots.empty() ? 16 : slots.size() * 2);
+		m_count = 0;
+		for(size_t i = 0; i < slots.size(); i++) if(slots[i].cache != NULL) insert(slots[i].id,slots[i].cache);
+	}
+
+	std::vector<Slot> m_slots;
+	int m_count;
+	unsigned int m_generation;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class ExMovePlugin : public MQCommandPlugin
+{
+public:
+	ExMovePlugin() 
+	{
+		m_highlightedelement.Reset();
+		m_moved = false;
+		m_cache_last_scene = NULL;
+		m_cache_view_key = 0;
+		m_view_stamp = 1;
+		m_cache_objects_changed = false;
+		m_drag_mode = 0;
+		m_hover_redraw_pending = false;
+		m_hover_scene = NULL;
+		m_hover_redraw_time = 0;
+		m_hover_pending = false;
+		m_highlight_material_doc = NULL;
+		m_highlight_material = NULL;
+		m_highlight_material_index = -1;
+		m_normal_weighting = NORMAL_WEIGHT_EQUAL;
+		m_region_visible_only = false;
+		m_region_shape = REGION_RECTANGLE;
+		m_region_polygon = false;
+		m_visibility_dirty = true;
+		m_soft_selection = SOFT_SELECTION_OFF;
+		m_soft_radius = 1.0f;
+		m_soft_falloff = SOFT_FALLOFF_SMOOTH;
+	}
+	~ExMovePlugin()
+	{
+	}
+
+	void GetPlugInID(DWORD *Product, DWORD *ID)
+	{
+		*Product = 0xabcdef0e;
+		*ID      = 0x00101010;
+	}
+
+	const char *GetPlugInName(void) { return "N-Move ver.1.0.1      Copyright(C) 2007 kth"; }
+
+	const char *EnumString(void) { return "N-Move"; }
+
+	BOOL Initialize() { return TRUE; }
+	void Exit() { s_workers.Shutdown(); }
+
+	BOOL Activate(MQDocument doc, BOOL flag);
+
+	BOOL OnMouseMove(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state);
+	void OnDraw(MQDocument doc, MQScene scene, int width, int height);
+
+	BOOL OnLeftButtonDown(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state);
+	BOOL OnLeftButtonMove(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state);
+	BOOL OnLeftButtonUp(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state);
+
+	BOOL OnRightButtonDown(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state);
+
+	void OnObjectModified(MQDocument doc) { refresh_edge_cache(doc); invalidate_vertex_caches(doc); m_cache_view_key = 0; }
+	// caches go with the objects. only new ones are made and the screen state of others is kept
+	void OnUpdateObjectList(MQDocument doc) { sweep_object_caches(doc); refresh_edge_cache(doc); m_pick_window.Reset(); m_cache_objects_changed = true; }
+
+
+
+
+	//void OnUpdateUndo(MQDocument doc, int i1, int i2) { m_cache_view_key = 0; }
+
+private:
+	void grow_bounds(MQDocument doc);
+	ObjectCache& get_object_cache(MQObject obj) { return m_objects.Get((UINT)obj->GetUniqueID()); }
+	ObjectCache* find_object_cache(MQDocument doc, int o);
+	void sweep_object_caches(MQDocument doc);
+	void invalidate_vertex_caches(MQDocument doc);
+	void validate_cache(MQDocument doc,MQScene scene);
+	void refresh_cache(MQDocument doc,MQScene scene);
+	unsigned int get_view_key(MQScene scene);
+	void refresh_edge_cache(MQDocument doc);
+	void pick_target(MQDocument doc, MQScene scene, POINT& mousepos, MQSelectElement* elm);
+	void gather_pick_window(MQDocument doc, MQScene scene, const MQPoint& p);
+	bool get_screen_bounds(MQScene scene, MQObject obj, float& l, float& r, float& b, float& t);
+	void hover(MQDocument doc, MQScene scene, POINT& mousepos, bool redraw);
+	const HighlightGeometry& get_highlight_geometry(MQScene scene, MQObject obj);
+	int get_highlight_material(MQDocument doc);
+	BOOL marge_vertices(MQDocument doc, MQScene scene);
+	void regional_select(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state);
+	void draw_region_outline(MQDocument doc, MQScene scene, const MQPoint* cursor);
+	void close_region_polygon(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state);
+	const VertexFaceAdjacency& get_adjacency(MQDocument doc, int o);
+	const FaceBVH& get_face_bvh(MQObject obj);
+	const FaceTriangulation& get_triangulation(MQObject obj);
+	const VisibilityBuffer& get_visibility(MQDocument doc, MQScene scene);
+	void patch_topology(MQObject obj, int o, const std::vector<int>& removed, const std::vector< std::vector<int> >& removed_corners, const std::vector<int>& added);
+	const VertexSpatialGrid& get_spatial_grid(MQDocument doc, int o, float cellsize);
+	const VertexSpatialGrid& get_falloff_grid(MQDocument doc, int o);
+	void get_symmetry_vertices(MQDocument doc, std::vector<MQSelectVertex>& in, std::vector<MQSelectVertex>& out);
+	void get_falloff_vertices(MQDocument doc, std::vector<FalloffVertex>& out);
+
+	MQSelectElement m_highlightedelement;
+	PickWindow m_pick_window;
+	std::map<MQScene, HighlightGeometry> m_highlight_geometry;
+	MQDocument m_highlight_material_doc;
+	MQMaterial m_highlight_material;
+	int m_highlight_material_index;
+
+	// mouse moves coming before the redraw asked for are picked once, when it is drawn
+	bool m_hover_redraw_pending;
+	MQScene m_hover_scene;
+	DWORD m_hover_redraw_time;
+	bool m_hover_pending;
+	POINT m_hover_pos;
+
+	bool m_regional_select_mode;
+	int m_region_shape;
+	// corners of the lasso or polygon being drawn, on the screen
+	std::vector<MQPoint> m_region_points;
+	// a polygon is being clicked. other clicks add corners to it until it is closed
+	bool m_region_polygon;
+	ScreenMask m_region_mask;
+	bool m_moved;
+	MQSelectElement m_togglereserve;
+
+	std::vector<MQSelectVertex> m_selection;
+	std::vector<MQSelectVertex> m_symmetry;
+	DragSession m_drag;
+	// vertices around the selection dragged along with it
+	int m_soft_selection;
+	float m_soft_radius;
+	int m_soft_falloff;
+	// which move the drag did last. 0 none, 1 standard, 2 normal aligned
+	int m_drag_mode;
+
+	float m_sc_dragbegin_z;
+	LONG m_mouse_sc_drag_x;
+	
+	MQPoint m_mouse_drag;
+	MQPoint m_mouse_drag_ignorey;
+
+	// where the mouse was when the current kind of move started
+	MQPoint m_drag_origin;
+	LONG m_drag_origin_x;
+
+	MQPoint m_mouse_sc_dragbegin;
+
+	// hash of the whole view state refresh_cache was done with. 0 forces a refresh
+	unsigned int m_cache_view_key;
+	MQScene m_cache_last_scene;
+	// counted up for each view. objects whose screen state has another stamp are refreshed
+	unsigned int m_view_stamp;
+	// some objects have lost their screen state since the last refresh. added ones, or ones edited by ourselves
+	bool m_cache_objects_changed;
+	std::map<MQScene, std::pair<int,int> > m_viewport_size;
+	
+	ScreenProjection m_projection;
+	ObjectCacheTable m_objects;
+	int m_normal_weighting;
+	// region selection leaves out what is hidden behind faces
+	bool m_region_visible_only;
+
+	// rendered from the screen state when it is asked for after a refresh
+	VisibilityBuffer m_visibility;
+	bool m_visibility_dirty;
+	std::vector<RasterTriangle> m_raster_triangles;
+
+	MQColor m_color_highlight;
+};
+
+static  ExMovePlugin s_plugin;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static void get_selection(MQDocument doc,MQScene scene,std::vector<MQSelectVertex>& out)
+{
+	PROFILE_SCOPE(PROFILE_GET_SELECTION);
+
+	std::vector<int> indices;
+
+	// dense bitsets per object, indexed by vertex
+	std::vector<unsigned int> selected;
+	std::vector<unsigned int> referred;
+
+	// for each objects
+	ObjectEnumerator objenum(doc);
+	for(MQObject obj = NULL; (obj = objenum.next()) != NULL;)
+	{
+		int o = objenum.GetIndex();
+		int face_count = obj->GetFaceCount();
+		int vcount = obj->GetVertexCount();
+		int words = (vcount + 31) / 32;
+
+		selected.assign(words, 0);
+		referred.assign(words, 0);
+
+		for(int f = 0; f < face_count; f++)
+		{
+			// pass through if it is invalid face (count of references to vertice = 0)
+			int ptcount = obj->GetFacePointCount(f);
+			if(ptcount == 0) continue;
+
+			indices.resize(ptcount);
+			obj->GetFacePointArray(f,&indices[0]);
+
+			for(int p = 0; p < ptcount; p++) referred[indices[p] >> 5] |= 1u << (indices[p] & 31);
+
+			// selected is a face
+			if(doc->IsSelectFace(o,f))
+			{
+				for(int p = 0; p < ptcount; p++) selected[indices[p] >> 5] |= 1u << (indices[p] & 31);
+				continue;
+			}
+
+			for(int p = 0; p < ptcount; p++)
+			{
+				if(doc->IsSelectLine(o,f,p))
+				{
+					int q = indices[(p+1)%ptcount];
+					selected[indices[p] >> 5] |= 1u << (indices[p] & 31);
+					selected[q >> 5] |= 1u << (q & 31);
+				}
+			}
+		}
+
+		// vertices of faces, each asked once
+		for(int w = 0; w < words; w++)
+		{
+			unsigned int pending = referred[w] & ~selected[w];
+			for(int b = 0; pending != 0; b++, pending >>= 1)
+			{
+				if((pending & 1) && doc->IsSelectVertex(o,w * 32 + b)) selected[w] |= 1u << b;
+			}
+		}
+
+		// in ascending order, grouped by object
+		for(int w = 0; w < words; w++)
+		{
+			unsigned int bits = selected[w];
+			for(int b = 0; bits != 0; b++, bits >>= 1)
+			{
+				if(bits & 1) out.push_back(MQSelectVertex(o,w * 32 + b));
+			}
+		}
+	}
+}	
+
+static bool is_point_in_triangle_2d(const MQPoint& p, const MQPoint& t1, const MQPoint& t2, const MQPoint& t3)
+{
+	return (
+		((t2.x-t1.x) * (p.y-t1.y) - (t2.y-t1.y) * (p.x-t1.x) > 0) &&
+		((t3.x-t2.x) * (p.y-t2.y) - (t3.y-t2.y) * (p.x-t2.x) > 0) &&
 		((t1.x-t3.x) * (p.y-t3.y) - (t1.y-t3.y) * (p.x-t3.x) > 0) 
 		);
 }
@@ -429,145 +3282,812 @@ static bool is_point_on_line_2d(const MQPoint& p, const MQPoint& t1, const MQPoi
 	return true;
 }
 
-static void get_vertex_disignated_normal(MQDocument doc, const MQSelectVertex& vaddr, MQPoint* nout)
+// whether the point of the line nearest to p is in front, or it is on a face having the line
+static bool is_line_visible(const VisibilityBuffer& visibility, int object, const MQPoint& p, const MQPoint& t1, const MQPoint& t2, int v1, int v2)
 {
-	// detection of normal vector
-	std::vector<MQPoint> normals;
+	if(!visibility.IsValid()) return true;
 
-	MQObject obj = doc->GetObject(vaddr.object);
+	float dx = t2.x - t1.x, dy = t2.y - t1.y;
+	float len2 = dx * dx + dy * dy;
+	float s = (len2 > 0) ? ((p.x - t1.x) * dx + (p.y - t1.y) * dy) / len2 : 0.0f;
+	s = min(1.0f,max(0.0f,s));
+
+	int vertices[2] = { v1, v2 };
+	return visibility.IsVisible(t1 + (t2 - t1) * s,object,vertices,2);
+}
+
+// angle at the corner of v in face f
+static float get_corner_angle(MQObject obj, int f, int v, std::vector<int>& corners)
+{
+	int pcount = obj->GetFacePointCount(f);
+	if(pcount < 3) return 0;
+	corners.resize(pcount);
+	obj->GetFacePointArray(f,&corners[0]);
+	for(int i = 0; i < pcount; i++)
+	{
+		if(corners[i] != v) continue;
+		MQPoint p = obj->GetVertex(v);
+		MQPoint a = obj->GetVertex(corners[(i+pcount-1)%pcount]) - p;
+		MQPoint b = obj->GetVertex(corners[(i+1)%pcount]) - p;
+		float len = a.abs() * b.abs();
+		if(len == 0) return 0;
+		float c = GetInnerProduct(a,b) / len;
+		return acosf(max(-1.0f,min(1.0f,c)));
+	}
+	return 0;
+}
 
-	std::vector<int> faces;
-	find_faces_contains_vertex(obj,vaddr.vertex,faces);
+// normals of vertices of an object, put together from the faces around them in one pass.
+// a face facing the opposite of one taken earlier is the back of a "both sided" face and is skipped
+static void get_vertex_normals(MQObject obj, const VertexFaceAdjacency& adjacency, FaceNormalCache& cache, int weighting, const int* vertices, int count, MQPoint* out)
+{
+	cache.Resize(obj->GetFaceCount());
 
-	for(std::vector<int>::iterator it = faces.begin(); it != faces.end(); ++it)
+	OppositeNormalSet taken;
+	std::vector<int> corners;
+	for(int i = 0; i < count; i++)
 	{
-		int vertices[4];
-		int points = obj->GetFacePointCount(*it);
-		obj->GetFacePointArray(*it,vertices);
-		MQPoint n(FLT_MAX,0,0);
-		if(points == 3) n = GetNormal(obj->GetVertex(vertices[0]),obj->GetVertex(vertices[1]),obj->GetVertex(vertices[2]));
-		else if(points == 4) n = GetQuadNormal(obj->GetVertex(vertices[0]),obj->GetVertex(vertices[1]),obj->GetVertex(vertices[2]),obj->GetVertex(vertices[3]));
-		else break;
-		if(n.x == FLT_MAX) break;
+		int v = vertices[i];
+		out[i].zero();
+		if(v >= adjacency.GetVertexCount()) continue;
+
+		const int* faces = adjacency.GetFaces(v);
+		int fcount = adjacency.GetFaceCount(v);
+		taken.Reset(fcount);
+
+		MQPoint n(0,0,0);
+		for(int k = 0; k < fcount; k++)
+		{
+			const MQPoint& fn = cache.GetNormal(obj,faces[k]);
+			if(fn.norm() == 0) continue;
+			if(taken.HasOpposite(fn)) continue;
+			taken.Insert(fn);
+
+			float w = 1.0f;
+			if(weighting == NORMAL_WEIGHT_AREA) w = cache.GetArea(obj,faces[k]);
+			else if(weighting == NORMAL_WEIGHT_ANGLE) w = get_corner_angle(obj,faces[k],v,corners);
+			n += fn * w;
+		}
+		if(n.norm() == 0) continue;
 		n.normalize();
-		normals.push_back(n);
+		out[i] = n;
 	}
+}
 
-	if(normals.size() == 0) { nout->zero(); return; }
+// weight of a vertex at t (0 to 1) of the soft selection radius
+static float get_falloff_weight(int falloff, float t)
+{
+	if(t >= 1.0f) return 0.0f;
+	if(falloff == SOFT_FALLOFF_LINEAR) return 1.0f - t;
+	return 1.0f - t * t * (3.0f - 2.0f * t);
+}
 
-	MQPoint& basenormal = normals[0];
-	size_t samplesize = normals.size();
+// shortest distances along edges from the sources, as far as the radius. dist is FLT_MAX for vertices out of reach.
+// vertices given a distance for the first time are added to reached
+static void get_geodesic_distances(MQObject obj, const VertexFaceAdjacency& adjacency, const std::vector<int>& sources, float radius, std::vector<float>& dist, std::vector<int>& reached)
+{
+	// a binary heap of (-distance, vertex). entries left behind by a shorter path are skipped when they come out
+	std::vector< std::pair<float,int> > heap;
+	for(size_t i = 0; i < sources.size(); i++)
+	{
+		int v = sources[i];
+		if(dist[v] == 0) continue;
+		if(dist[v] == FLT_MAX) reached.push_back(v);
+		dist[v] = 0;
+		heap.push_back(std::pair<float,int>(0.0f,v));
+	}
+	std::make_heap(heap.begin(),heap.end());
 
-	// skip normal that designed for "both sided" face
-	for(std::vector<MQPoint>::iterator it = normals.begin(); it != normals.end(); ++it)
+	std::vector<int> corners;
+	while(!heap.empty())
 	{
-		// search for a vector which has counter direction 
-		for(std::vector<MQPoint>::iterator it2 = normals.begin(); it2 != normals.end(); ++it2)
+		std::pop_heap(heap.begin(),heap.end());
+		float d = -heap.back().first;
+		int v = heap.back().second;
+		heap.pop_back();
+		if(d > dist[v]) continue;
+
+		MQPoint p = obj->GetVertex(v);
+		const int* faces = adjacency.GetFaces(v);
+		int fcount = adjacency.GetFaceCount(v);
+		for(int k = 0; k < fcount; k++)
 		{
-			if(it2->norm() == 0) continue;
-			if(GetInnerProduct(*it,*it2) < -0.999f)
+			int pcount = obj->GetFacePointCount(faces[k]);
+			if(pcount < 2) continue;
+			corners.resize(pcount);
+			obj->GetFacePointArray(faces[k],&corners[0]);
+			for(int i = 0; i < pcount; i++)
 			{
-				it2->zero();
-				samplesize--;
+				if(corners[i] != v) continue;
+				// both neighbors along the face. an edge shared by two faces is tried twice, which does no harm
+				for(int side = 0; side < 2; side++)
+				{
+					int n = corners[(side == 0) ? (i + 1) % pcount : (i + pcount - 1) % pcount];
+					if(n == v || n < 0 || n >= (int)dist.size()) continue;
+					float nd = d + (obj->GetVertex(n) - p).abs();
+					if(nd > radius || nd >= dist[n]) continue;
+					if(dist[n] == FLT_MAX) reached.push_back(n);
+					dist[n] = nd;
+					heap.push_back(std::pair<float,int>(-nd,n));
+					std::push_heap(heap.begin(),heap.end());
+				}
 			}
 		}
 	}
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+void ExMovePlugin::refresh_edge_cache(MQDocument doc)
+{
+	PROFILE_SCOPE(PROFILE_REFRESH_EDGE_CACHE);
+
+	std::set<int> enumerated;
+
+	ObjectEnumerator objenum(doc,OE_SKIPHIDDEN | OE_SKIPLOCKED);
+	for(MQObject obj = NULL; (obj = objenum.next()) != NULL; )
+	{
+		int o = objenum.GetIndex();
+		enumerated.insert(o);
+
+		// vertices may have been moved, but caches depend on topology only
+		TopologySignature sig;
+		sig.Compute(obj);
+		ObjectCache& cache = get_object_cache(obj);
+		if(cache.topology_built && cache.topology.IsSameTopology(sig)) continue;
+
+		sig.version = cache.topology.version + 1;
+		cache.topology = sig;
+		cache.topology_built = true;
+		cache.edges.Build(obj);
+		cache.adjacency.Build(obj);
+	}
 
+	// hidden or locked objects may change unnoticed. they are built again when they come back
+	for(int o = 0; o < doc->GetObjectCount(); o++)
+	{
+		if(enumerated.find(o) != enumerated.end()) continue;
+		ObjectCache* cache = find_object_cache(doc,o);
+		if(cache != NULL) cache->ClearTopology();
+	}
+}
+
+void ExMovePlugin::patch_topology(MQObject obj, int o, const std::vector<int>& removed, const std::vector< std::vector<int> >& removed_corners, const std::vector<int>& added)
+{
+	ObjectCache& cache = get_object_cache(obj);
+	VertexFaceAdjacency& adjacency = cache.adjacency;
 
-	MQPoint n(0,0,0);
-	for(std::vector<MQPoint>::iterator it = normals.begin(); it != normals.end(); ++it)
+	// not cached as a whole. leave it to the next refresh, but the bvh and triangulation built for this version are stale anyway
+	if(!adjacency.IsValid() || !cache.topology_built)
 	{
-		n += *it;
+		adjacency.Clear();
+		cache.edges.Clear();
+		cache.normals.Clear();
+		cache.topology_built = false;
+		cache.topology.version++;
+		return;
 	}
-	n /= (float)samplesize;
-	n.normalize();
 
-	*nout = n;
+	adjacency.Patch(obj,removed,removed_corners,added);
+	cache.edges.Patch(obj,adjacency,removed,removed_corners,added);
+
+	FaceNormalCache& normals = cache.normals;
+	normals.Resize(obj->GetFaceCount());
+	for(size_t r = 0; r < removed.size(); r++) normals.MarkDirty(removed[r]);
+	for(size_t a = 0; a < added.size(); a++) normals.MarkDirty(added[a]);
+
+	TopologySignature& s = cache.topology;
+	for(size_t r = 0; r < removed.size(); r++)
+	{
+		if(removed_corners[r].empty()) continue;
+		s.hash -= TopologySignature::HashFace(removed[r],&removed_corners[r][0],(int)removed_corners[r].size());
+	}
+	std::vector<int> indices;
+	for(size_t a = 0; a < added.size(); a++)
+	{
+		int pcount = obj->GetFacePointCount(added[a]);
+		if(pcount == 0) continue;
+		indices.resize(pcount);
+		obj->GetFacePointArray(added[a],&indices[0]);
+		s.hash += TopologySignature::HashFace(added[a],&indices[0],pcount);
+	}
+	s.vcount = obj->GetVertexCount();
+	s.fcount = obj->GetFaceCount();
+	s.version++;
 }
 
+ObjectCache* ExMovePlugin::find_object_cache(MQDocument doc, int o)
+{
+	MQObject obj = doc->GetObject(o);
+	if(obj == NULL) return NULL;
+	return m_objects.Find((UINT)obj->GetUniqueID());
+}
+
+void ExMovePlugin::sweep_object_caches(MQDocument doc)
+{
+	// caches of deleted objects go. the others stay where they are, whatever index their objects have now
+	m_objects.BeginSweep();
+	for(int o = 0; o < doc->GetObjectCount(); o++)
+	{
+		MQObject obj = doc->GetObject(o);
+		if(obj != NULL) m_objects.Mark((UINT)obj->GetUniqueID());
+	}
+	m_objects.EndSweep();
 
+	// the buffer may point to triangulations of deleted objects
+	m_visibility.Invalidate();
+	m_visibility_dirty = true;
+	// versions of new caches start again, and the highlight would match one of a deleted object
+	m_highlight_geometry.clear();
+}
 
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void ExMovePlugin::invalidate_vertex_caches(MQDocument doc)
+{
+	// any object may have been changed by others. those whose positions and topology are as they were keep their caches
+	for(int o = 0; o < doc->GetObjectCount(); o++)
+	{
+		MQObject obj = doc->GetObject(o);
+		if(obj == NULL) continue;
+		ObjectCache* cache = m_objects.Find((UINT)obj->GetUniqueID());
+		if(cache == NULL) continue;
+		unsigned int hash = get_position_hash(obj);
+		if(hash == cache->position_hash && cache->topology.version == cache->position_topology) continue;
+		cache->position_hash = hash;
+		cache->position_topology = cache->topology.version;
+
+		cache->vertex_version++;
+		cache->bvh.MarkDirty();
+		cache->triangulation.Clear();
+		cache->spatial.Clear();
+		cache->falloff.Clear();
+		cache->bounds.valid = false;
+		cache->normals.Clear();
+		cache->facing = FaceFacingCache();
+	}
+}
+
+const VertexFaceAdjacency& ExMovePlugin::get_adjacency(MQDocument doc, int o)
+{
+	// objects out of the edge cache (or modified by ourselves) are built on demand
+	static const VertexFaceAdjacency empty;
+	MQObject obj = doc->GetObject(o);
+	if(obj == NULL) return empty;
+	VertexFaceAdjacency& adjacency = get_object_cache(obj).adjacency;
+	if(!adjacency.IsValid()) adjacency.Build(obj);
+	return adjacency;
+}
+
+const FaceBVH& ExMovePlugin::get_face_bvh(MQObject obj)
+{
+	// rebuilt when the topology has changed, refitted when vertices have been moved
+	ObjectCache& cache = get_object_cache(obj);
+	unsigned int version = cache.topology.version;
+
+	FaceBVH& bvh = cache.bvh;
+	if(!bvh.IsBuiltFor(version)) bvh.Build(obj,version);
+	else if(bvh.IsDirty()) bvh.Refit(obj);
+	return bvh;
+}
+
+const FaceTriangulation& ExMovePlugin::get_triangulation(MQObject obj)
+{
+	// made again only when the topology has changed. objects out of the edge cache are checked by the count of faces
+	ObjectCache& cache = get_object_cache(obj);
+	unsigned int version = cache.topology.version;
+
+	FaceTriangulation& triangulation = cache.triangulation;
+	if(!triangulation.IsBuiltFor(version) || triangulation.GetFaceCount() != obj->GetFaceCount()) triangulation.Build(obj,version);
+	return triangulation;
+}
+
+const VisibilityBuffer& ExMovePlugin::get_visibility(MQDocument doc, MQScene scene)
+{
+	if(!m_visibility_dirty) return m_visibility;
+	m_visibility_dirty = false;
+
+	PROFILE_SCOPE(PROFILE_RENDER_VISIBILITY);
+
+	// nothing to render into until the scene has been drawn once
+	std::pair<int,int>& size = m_viewport_size[scene];
+	if(size.first <= 0 || size.second <= 0) { m_visibility.Invalidate(); return m_visibility; }
+
+	// triangles of editable faces in the order of objects and faces. ones reaching behind the eye are left out
+	std::vector<VisibilityBuffer::Face> faces;
+	std::vector<RasterTriangle>& triangles = m_raster_triangles;
+	triangles.clear();
+	ObjectEnumerator objenum(doc);
+	for(MQObject obj = NULL; (obj = objenum.next()) != NULL;)
+	{
+		ObjectCache& cache = get_object_cache(obj);
+		if(cache.view_stamp != m_view_stamp) continue;
+
+		const FaceTriangulation& triangulation = get_triangulation(obj);
+		const std::vector<MQPoint>& screen = cache.screen_positions;
+		const std::vector<int>& editable = cache.editable_faces;
+		for(size_t i = 0; i < editable.size(); i++)
+		{
+			int f = editable[i];
+			if(f >= triangulation.GetFaceCount()) continue;
+			const int* corners = triangulation.GetCorners(f);
+			const int* tri = triangulation.GetTriangles(f);
+			unsigned int id = (unsigned int)faces.size() + 1;
+			bool used = false;
+			for(int k = 0; k < triangulation.GetTriangleCount(f); k++, tri += 3)
+			{
+				RasterTriangle t;
+				int j = 0;
+				for(; j < 3; j++)
+				{
+					if((unsigned int)corners[tri[j]] >= screen.size()) break;
+					const MQPoint& p = screen[corners[tri[j]]];
+					if(p.z < 0) break;
+					t.x[j] = p.x; t.y[j] = p.y; t.z[j] = p.z;
+				}
+				if(j < 3) continue;
+				t.id = id;
+				triangles.push_back(t);
+				used = true;
+			}
+			if(!used) continue;
+			VisibilityBuffer::Face face;
+			face.object = objenum.GetIndex();
+			face.face = f;
+			face.triangulation = &triangulation;
+			faces.push_back(face);
+		}
+	}
+
+	m_visibility.Render(faces,triangles,size.first,size.second);
+	return m_visibility;
+}
+
+const VertexSpatialGrid& ExMovePlugin::get_spatial_grid(MQDocument doc, int o, float cellsize)
+{
+	static const VertexSpatialGrid empty;
+	MQObject obj = doc->GetObject(o);
+	if(obj == NULL) return empty;
+	VertexSpatialGrid& grid = get_object_cache(obj).spatial;
+	if(!grid.IsValid() || grid.GetCellSize() != cellsize) grid.Build(obj,cellsize);
+	return grid;
+}
+
+// cells as large as the soft selection radius, so a gather reads 27 cells at most
+const VertexSpatialGrid& ExMovePlugin::get_falloff_grid(MQDocument doc, int o)
+{
+	static const VertexSpatialGrid empty;
+	MQObject obj = doc->GetObject(o);
+	if(obj == NULL) return empty;
+	VertexSpatialGrid& grid = get_object_cache(obj).falloff;
+	if(!grid.IsValid() || grid.GetCellSize() != m_soft_radius) grid.Build(obj,m_soft_radius);
+	return grid;
+}
+
+// rectangle on the screen covering the box of an object. false when it cannot be told, as a corner is behind the camera
+bool ExMovePlugin::get_screen_bounds(MQScene scene, MQObject obj, float& l, float& r, float& b, float& t)
+{
+	ObjectBounds& bounds = get_object_cache(obj).bounds;
+	if(!bounds.valid) bounds.Build(obj);
+	if(!bounds.valid) return false;
+
+	for(int i = 0; i < 8; i++)
+	{
+		MQPoint c((i & 1) ? bounds.bmax.x : bounds.bmin.x,(i & 2) ? bounds.bmax.y : bounds.bmin.y,(i & 4) ? bounds.bmax.z : bounds.bmin.z);
+		MQPoint sp;
+		if(m_projection.IsValid())
+		{
+			sp = m_projection.Project(c);
+			if(sp.z < 0) return false;
+		}
+		else
+		{
+			float w;
+			sp = scene->Convert3DToScreen(c,&w);
+			if(w <= 0) return false;
+		}
+		if(i == 0) { l = r = sp.x; b = t = sp.y; continue; }
+		l = min(l,sp.x); r = max(r,sp.x);
+		b = min(b,sp.y); t = max(t,sp.y);
+	}
+	return true;
+}
+
+// boxes of dragged objects take in where the vertices have gone
+// after each move of a drag. positions read from the dragged objects are stale too
+void ExMovePlugin::grow_bounds(MQDocument doc)
+{
+	for(int g = 0; g < m_drag.GetGroupCount(); g++)
+	{
+		ObjectCache* cache = find_object_cache(doc,m_drag.GetGroupObject(g));
+		if(cache == NULL) continue;
+		cache->vertex_version++;
+		if(!cache->bounds.valid) continue;
+		MQPoint bmin, bmax;
+		if(!m_drag.GetMovedBounds(g,bmin,bmax)) continue;
+		cache->bounds.Grow(bmin);
+		cache->bounds.Grow(bmax);
+	}
+}
+
+unsigned int ExMovePlugin::get_view_key(MQScene scene)
+{
+	float state[15];
+	MQPoint pos = scene->GetCameraPosition();
+	MQAngle angle = scene->GetCameraAngle();
+	MQPoint lookat = scene->GetLookAtPosition();
+	MQPoint center = scene->GetRotationCenter();
+	std::pair<int,int>& size = m_viewport_size[scene];
+
+	state[0] = pos.x; state[1] = pos.y; state[2] = pos.z;
+	state[3] = angle.head; state[4] = angle.pitch; state[5] = angle.bank;
+	state[6] = lookat.x; state[7] = lookat.y; state[8] = lookat.z;
+	state[9] = center.x; state[10] = center.y; state[11] = center.z;
+	state[12] = scene->GetFOV();
+	state[13] = (float)size.first;
+	state[14] = (float)size.second;
+
+	// FNV-1a
+	unsigned int h = 2166136261u;
+	const unsigned char* bytes = (const unsigned char*)state;
+	for(size_t i = 0; i < sizeof(state); i++) { h ^= bytes[i]; h *= 16777619u; }
+	return (h == 0) ? 1 : h;
+}
+
+void ExMovePlugin::validate_cache(MQDocument doc,MQScene scene)
+{
+	// do refresh_cache if anything of the view is changed
+	unsigned int key = get_view_key(scene);
+	if(m_cache_last_scene != scene || m_cache_view_key != key)	
+	{
+		// the screen state of every object is stale
+		if(++m_view_stamp == 0) m_view_stamp = 1;
+		refresh_cache(doc,scene);
+		m_cache_view_key = key;
+		m_cache_last_scene = scene;
+	}
+	else if(m_cache_objects_changed)
+	{
+		// only objects which have not been seen in this view
+		refresh_cache(doc,scene);
+	}
+	m_cache_objects_changed = false;
+}
+
+void ExMovePlugin::refresh_cache(MQDocument doc,MQScene scene)
+{
+	PROFILE_SCOPE(PROFILE_REFRESH_CACHE);
+
+	// once per view change. every projection until the next one goes through this
+	m_projection.Extract(scene);
+	m_pick_window.Reset();
+	m_visibility_dirty = true;
+
+	// facing does not depend on the eye position in parallel projections. a point far back along the view stands for it
+	MQPoint eye;
+	bool incremental = m_projection.GetEye(eye);
+	if(!incremental)
+	{
+		MQPoint dir = scene->ConvertScreenTo3D(MQPoint(0,0,0.6f)) - scene->ConvertScreenTo3D(MQPoint(0,0,0.3f));
+		incremental = (dir.norm() > 0);
+		if(incremental) { dir.normalize(); eye = scene->ConvertScreenTo3D(MQPoint(0,0,0.3f)) - dir * 1e6f; }
+		else eye = scene->GetCameraPosition();
+	}
+
+	// the SDK is asked on this thread only
+	std::vector<ViewRefreshJob> jobs;
+	ObjectEnumerator objenum(doc);
+	for(MQObject obj = NULL; (obj = objenum.next()) != NULL;)
+	{
+		ObjectCache& cache = get_object_cache(obj);
+		if(cache.view_stamp == m_view_stamp) continue;
+		cache.view_stamp = m_view_stamp;
+
+		int fcount = obj->GetFaceCount();
+		int vcount = obj->GetVertexCount();
+		ViewRefreshBuffers& buffers = cache.view_buffers;
+		buffers.visible.resize(fcount + 1);
+		scene->GetVisibleFace(obj,&buffers.visible[0]);
+
+		buffers.x.resize(vcount);
+		buffers.y.resize(vcount);
+		buffers.z.resize(vcount);
+		for(int v = 0; v < vcount; v++)
+		{
+			MQPoint p = obj->GetVertex(v);
+			buffers.x[v] = p.x; buffers.y[v] = p.y; buffers.z[v] = p.z;
+		}
+
+		// projected once for picking. the scene does it when the projection could not be recovered
+		std::vector<MQPoint>& positions = cache.screen_positions;
+		positions.resize(vcount);
+		PROFILE_COUNT(PROFILE_VERTICES_PROJECTED,vcount);
+		if(!m_projection.IsValid())
+		{
+			for(int v = 0; v < vcount; v++) positions[v] = scene->Convert3DToScreen(MQPoint(buffers.x[v],buffers.y[v],buffers.z[v]));
+		}
+
+		// planes are kept while the eye moves in the same scene. anything else tests all faces again
+		FaceFacingCache& facing = cache.facing;
+		bool full = !(incremental && facing.scene == scene && facing.consistent && (int)facing.front.size() == fcount);
+		if(full)
+		{
+			facing.scene = scene;
+			facing.normal.resize(fcount);
+			facing.center.resize(fcount);
+			facing.plane_d.resize(fcount);
+			facing.slack.resize(fcount);
+			facing.bend.resize(fcount);
+			facing.dist.resize(fcount);
+			facing.front.resize(fcount);
+		}
+
+		jobs.push_back(ViewRefreshJob());
+		ViewRefreshJob& job = jobs.back();
+		job.cache = &cache;
+		job.obj = obj;
+		job.buffers = &buffers;
+		job.facing = &facing;
+		job.faces = &get_triangulation(obj);
+		job.projection = &m_projection;
+		job.screen = &positions;
+		job.eye = eye;
+		job.full = full;
+	}
+
+	// huge objects are split into chunks. the pool hands them out one at a time, so idle threads take what is left
+	const int face_chunk = 16384, vertex_chunk = 65536;
+	std::vector<FacingTask> ftasks;
+	std::vector<ProjectTask> ptasks;
+	for(size_t j = 0; j < jobs.size(); j++)
+	{
+		int fcount = (int)jobs[j].facing->front.size();
+		for(int begin = 0; begin < fcount; begin += face_chunk) ftasks.push_back(FacingTask(&jobs[j],begin,min(begin + face_chunk,fcount)));
+		if(!m_projection.IsValid()) continue;
+		int vcount = (int)jobs[j].screen->size();
+		for(int begin = 0; begin < vcount; begin += vertex_chunk) ptasks.push_back(ProjectTask(&jobs[j],begin,min(begin + vertex_chunk,vcount)));
+	}
+
+	std::vector<WorkerTask*> tasks;
+	for(size_t i = 0; i < ftasks.size(); i++) tasks.push_back(&ftasks[i]);
+	for(size_t i = 0; i < ptasks.size(); i++) tasks.push_back(&ptasks[i]);
+	s_workers.Run(tasks);
+
+	// faces near the silhouette are left to IsFrontFace
+	for(size_t i = 0; i < ftasks.size(); i++)
+	{
+		const ViewRefreshJob& job = *ftasks[i].GetJob();
+		const std::vector<int>& retest = ftasks[i].retest;
+		for(size_t k = 0; k < retest.size(); k++) job.facing->front[retest[k]] = IsFrontFace(scene,job.obj,retest[k]) ? 1 : 0;
+	}
+
+	for(size_t j = 0; j < jobs.size(); j++)
+	{
+		ViewRefreshJob& job = jobs[j];
+		FaceFacingCache& facing = *job.facing;
+		ViewRefreshBuffers& buffers = *job.buffers;
+		int fcount = (int)facing.front.size();
+
+		if(job.full)
+		{
+			int agree = 0, disagree = 0;
+			for(int f = 0; f < fcount; f++)
+			{
+				facing.front[f] = IsFrontFace(scene,job.obj,f) ? 1 : 0;
+				if(fabs(facing.dist[f]) <= facing.GetTolerance(f,job.eye)) continue;
+				if((facing.dist[f] > 0) == (facing.front[f] != 0)) agree++; else disagree++;
+			}
+
+			// the winding convention does not matter, but it has to be the same for all faces
+			facing.consistent = (agree == 0 || disagree == 0);
+		}
+		facing.eye = job.eye;
+
+		// editable faces and the vertices they refer, in ascending order
+		std::vector<int>& faces = job.cache->editable_faces;
+		faces.clear();
+		buffers.referred.assign(job.screen->size(),0);
+		for(int f = 0; f < fcount; f++)
+		{
+			if(!facing.front[f] || buffers.visible[f] != TRUE) continue;
+			faces.push_back(f);
+			const int* corners = job.faces->GetCorners(f);
+			for(int i = 0; i < job.faces->GetCornerCount(f); i++) if((unsigned int)corners[i] < buffers.referred.size()) buffers.referred[corners[i]] = 1;
+		}
+		std::vector<int>& vertices = job.cache->editable_vertices;
+		vertices.clear();
+		for(int v = 0; v < (int)buffers.referred.size(); v++) if(buffers.referred[v]) vertices.push_back(v);
+
+		std::vector<MQPoint> screen(vertices.size());
+		for(size_t i = 0; i < vertices.size(); i++) screen[i] = (*job.screen)[vertices[i]];
+		job.cache->screen_vertices.Build(vertices,screen,THRESHOLD_PICK_POINT);
+	}
+}
+
+void ExMovePlugin::get_symmetry_vertices(MQDocument doc, std::vector<MQSelectVertex>& in, std::vector<MQSelectVertex>& out)
+{
+	if(!s_editoption.Symmetry) return;
+
+	//float distance = s_editoption.SymmetryDistance * s_editoption.SymmetryDistance;
+	// we get only 0.0. I don't know why. 
+	float distance = 1.0f;
+
+	for(std::vector<MQSelectVertex>::iterator it = in.begin(); it != in.end(); ++it)
+	{
+		MQObject obj = doc->GetObject(it->object);
+		if(obj == NULL) continue;
+
+		MQPoint p0 = obj->GetVertex(it->vertex);
+		p0.x = -p0.x;
 
+		int symmetryv = get_spatial_grid(doc,it->object,distance).FindNearest(p0,distance);
+		
+		if(symmetryv != -1) out.push_back(MQSelectVertex(it->object,symmetryv));
+	}
+}
 
-void ExMovePlugin::refresh_edge_cache(MQDocument doc)
+// vertices within the soft selection radius of the selection or the symmetry, weighted by how near they are to each.
+// the selection and the symmetry themselves are left out
+void ExMovePlugin::get_falloff_vertices(MQDocument doc, std::vector<FalloffVertex>& out)
 {
-	m_cache_edges.clear();
-
-	ObjectEnumerator objenum(doc,OE_SKIPHIDDEN | OE_SKIPLOCKED);
-	for(MQObject obj = NULL; (obj = objenum.next()) != NULL; )
+	PROFILE_SCOPE(PROFILE_SOFT_SELECTION);
+
+	out.clear();
+	if(m_soft_selection == SOFT_SELECTION_OFF || !(m_soft_radius > 0)) return;
+
+	// hard vertices of each object. (vertex, 0 for selection / 1 for symmetry)
+	std::map<int, std::vector< std::pair<int,int> > > hard;
+	for(size_t i = 0; i < m_selection.size(); i++) hard[m_selection[i].object].push_back(std::pair<int,int>(m_selection[i].vertex,0));
+	for(size_t i = 0; i < m_symmetry.size(); i++) hard[m_symmetry[i].object].push_back(std::pair<int,int>(m_symmetry[i].vertex,1));
+
+	std::vector<int> sources[2];
+	std::vector<float> dist[2];
+	std::vector<unsigned char> hardflag;
+	std::vector<int> reached;
+	std::vector<MQPoint> points;
+	for(std::map<int, std::vector< std::pair<int,int> > >::iterator it = hard.begin(); it != hard.end(); ++it)
 	{
-		std::set< std::pair<int,int> > tmp;
+		int o = it->first;
+		MQObject obj = doc->GetObject(o);
+		if(obj == NULL) continue;
+		int vcount = obj->GetVertexCount();
 
-		std::vector< std::vector<int> >& otarget = m_cache_edges[objenum.GetIndex()];
-		otarget.reserve(100);
+		hardflag.assign(vcount,0);
+		sources[0].clear();
+		sources[1].clear();
+		for(size_t i = 0; i < it->second.size(); i++)
+		{
+			int v = it->second[i].first;
+			if(v < 0 || v >= vcount) continue;
+			hardflag[v] = 1;
+			sources[it->second[i].second].push_back(v);
+		}
 
-		int fcount = obj->GetFaceCount();
-		for(int f = 0; f < fcount; f++)
+		// distances from the selection and from the symmetry apart, as they move to opposite sides in x
+		reached.clear();
+		for(int pass = 0; pass < 2; pass++)
 		{
-			std::vector<int> edges;
-			edges.reserve(4);
+			dist[pass].assign(vcount,FLT_MAX);
+			if(sources[pass].empty()) continue;
 
-			int ecount = obj->GetFacePointCount(f);
-			int indices[4];
-			obj->GetFacePointArray(f,indices);
-			for(int i = 0; i < ecount; i++)
+			if(m_soft_selection == SOFT_SELECTION_GEODESIC)
 			{
-				std::pair<int,int> p(indices[i],indices[(i+1)%ecount]);
-				if(p.first < p.second) std::swap(p.first,p.second);
-				if(tmp.find(p) == tmp.end())
-				{
-					tmp.insert(p);
-					edges.push_back(i);
-				}
+				get_geodesic_distances(obj,get_adjacency(doc,o),sources[pass],m_soft_radius,dist[pass],reached);
+				continue;
 			}
-			otarget.push_back(edges);
+
+			// all hard vertices at once. they are left out, and each vertex around is read once
+			points.resize(sources[pass].size());
+			for(size_t i = 0; i < sources[pass].size(); i++) points[i] = obj->GetVertex(sources[pass][i]);
+			get_falloff_grid(doc,o).GatherNearest(points,m_soft_radius,hardflag,dist[pass],reached);
+		}
+
+		// each vertex once. reached by both passes, it has both weights
+		for(size_t i = 0; i < reached.size(); i++)
+		{
+			int v = reached[i];
+			if(hardflag[v]) continue;
+			hardflag[v] = 2;
+
+			FalloffVertex fv;
+			fv.vertex = MQSelectVertex(o,v);
+			fv.selection = (dist[0][v] == FLT_MAX) ? 0.0f : get_falloff_weight(m_soft_falloff,dist[0][v] / m_soft_radius);
+			fv.symmetry = (dist[1][v] == FLT_MAX) ? 0.0f : get_falloff_weight(m_soft_falloff,dist[1][v] / m_soft_radius);
+			if(fv.selection == 0 && fv.symmetry == 0) continue;
+			out.push_back(fv);
 		}
 	}
 }
 
-void ExMovePlugin::refresh_cache(MQDocument doc,MQScene scene)
+// a cone around the ray under the cursor, which contains everything projected within the radius (in pixels).
+// its radius at distance t from the origin is r0 + slope * t. it becomes a cylinder in parallel projections
+static void get_pick_cone(MQScene scene, const MQPoint& sp, float radius, MQPoint& origin, MQPoint& dir, float& r0, float& slope)
+{
+	const float znear = 0.00001f, zfar = 0.9f;
+
+	origin = scene->ConvertScreenTo3D(MQPoint(sp.x,sp.y,znear));
+	MQPoint pfar = scene->ConvertScreenTo3D(MQPoint(sp.x,sp.y,zfar));
+	dir = pfar - origin;
+	float len = dir.abs();
+	if(len == 0) { dir = MQPoint(0,0,1); r0 = FLT_MAX; slope = 0; return; }
+	dir /= len;
+
+	static const float offsets[4][2] = { {1,0}, {-1,0}, {0,1}, {0,-1} };
+	float rnear = 0, rfar = 0;
+	for(int i = 0; i < 4; i++)
+	{
+		MQPoint qnear = scene->ConvertScreenTo3D(MQPoint(sp.x + offsets[i][0] * radius,sp.y + offsets[i][1] * radius,znear));
+		MQPoint qfar = scene->ConvertScreenTo3D(MQPoint(sp.x + offsets[i][0] * radius,sp.y + offsets[i][1] * radius,zfar));
+		rnear = max(rnear,(qnear - origin).abs());
+		rfar = max(rfar,(qfar - pfar).abs());
+	}
+
+	// a little margin for the pixels not being uniform in angle
+	r0 = rnear * 1.25f;
+	slope = (rfar - rnear) / len * 1.25f;
+}
+
+void ExMovePlugin::gather_pick_window(MQDocument doc, MQScene scene, const MQPoint& p)
 {
-	m_cache_editable_faces.clear();
-	m_cache_editable_vertices.clear();
+	m_pick_window.Set(p,s_editoption);
+
+	// faces out of the cone can neither contain the cursor nor have an edge near it.
+	// the face under the cursor is read from the visibility buffer, so faces are needed only for lines then
+	bool pick_faces = s_editoption.EditLine || (s_editoption.EditFace && !m_visibility.IsValid());
+	MQPoint ray_origin, ray_dir;
+	float cone_r0 = 0, cone_slope = 0;
+	if(pick_faces) get_pick_cone(scene,p,max(THRESHOLD_PICK_LINE * 2.0f,THRESHOLD_PICK_POINT) + PICK_WINDOW_MARGIN,ray_origin,ray_dir,cone_r0,cone_slope);
 
+	// objects whose boxes are not around the window are left out as a whole
+	float reach = max(THRESHOLD_PICK_LINE * 2.0f,THRESHOLD_PICK_POINT) + PICK_WINDOW_MARGIN;
+
+	std::vector<int> candidates;
 
 	ObjectEnumerator objenum(doc);
 	for(MQObject obj = NULL; (obj = objenum.next()) != NULL;)
 	{
-		std::set<int> vtmp;
-		std::vector<int>& faces = m_cache_editable_faces[objenum.GetIndex()];
+		int o = objenum.GetIndex();
+		ObjectCache& cache = get_object_cache(obj);
+		if(cache.view_stamp != m_view_stamp) continue;
 
-		int fcount = obj->GetFaceCount();
-		BOOL* avisibility = new BOOL[fcount];
-		scene->GetVisibleFace(obj,avisibility);
+		float l, r, b, t;
+		if(get_screen_bounds(scene,obj,l,r,b,t) && (p.x < l - reach || r + reach < p.x || p.y < b - reach || t + reach < p.y)) continue;
 
+		m_pick_window.objects.push_back(PickWindow::Candidates());
+		PickWindow::Candidates& cand = m_pick_window.objects.back();
+		cand.object = o;
 
-		for(int f = 0; f < fcount; f++)
-		{
-			if(IsFrontFace(scene,obj,f) && avisibility[f] == TRUE)
-			{
-				faces.push_back(f);
-				int vindices[5] = {-1,-1,-1,-1,-1};
-				obj->GetFacePointArray(f,vindices);
-				for(int i = 0; vindices[i] != -1; i++) vtmp.insert(vindices[i]);
-			}
-		}
-		std::vector<int>& vertices = m_cache_editable_vertices[objenum.GetIndex()];
-		vertices.reserve(vtmp.size());
-		for(std::set<int>::iterator it = vtmp.begin(); it != vtmp.end(); ++it) vertices.push_back(*it);
-	}
+		// only cells around the cursor are read
+		if(s_editoption.EditVertex) cache.screen_vertices.Gather(p,THRESHOLD_PICK_POINT + PICK_WINDOW_MARGIN,cand.vertices,cand.points);
 
+		if(!pick_faces) continue;
+		if((int)cache.screen_positions.size() != obj->GetVertexCount()) continue;
 
+		// faces are tested in the same order as before, so the same one wins
+		candidates.clear();
+		get_face_bvh(obj).QueryCone(ray_origin,ray_dir,cone_r0,cone_slope,candidates);
+		std::sort(candidates.begin(),candidates.end());
+		std::vector<int>& editable = cache.editable_faces;
+		std::set_intersection(editable.begin(),editable.end(),candidates.begin(),candidates.end(),std::back_inserter(cand.faces));
+	}
 }
 
 void ExMovePlugin::pick_target(MQDocument doc, MQScene scene, POINT& mousepos, MQSelectElement* elm)
 {
+	PROFILE_SCOPE(PROFILE_PICK);
+
 	elm->Reset();
 
 	MQPoint clickpos((float)mousepos.x, (float)mousepos.y, 0);
 	float mindist = THRESHOLD_PICK_POINT * THRESHOLD_PICK_POINT;
 
+	// rendered once after each refresh. hidden vertices and lines are not picked through faces
+	const VisibilityBuffer& visibility = get_visibility(doc,scene);
+
+	// nothing out of the window can be picked while the cursor stays in it
+	if(!m_pick_window.Covers(clickpos,s_editoption)) gather_pick_window(doc,scene,clickpos);
+
 	MQSelectElement picked_item;
 
 	MQSelectElement picked_vertex;
@@ -578,23 +4098,25 @@ void ExMovePlugin::pick_target(MQDocument doc, MQScene scene, POINT& mousepos, M
 	if(s_editoption.EditVertex)
 	{
 		// pick a vertex
-		ObjectEnumerator objenum(doc);
 		float camera_z = 1.0f;
-		for(MQObject obj = NULL; (obj = objenum.next()) != NULL;)
+		for(size_t c = 0; c < m_pick_window.objects.size(); c++)
 		{
-			std::vector<int>& vertices = m_cache_editable_vertices[objenum.GetIndex()];
-
-			for(std::vector<int>::iterator it = vertices.begin(); it != vertices.end(); ++it)
+			// the same rule as ScreenPointGrid::FindNearest
+			const PickWindow::Candidates& cand = m_pick_window.objects[c];
+			PROFILE_COUNT(PROFILE_VERTICES_TESTED,(int)cand.vertices.size());
+			int v = -1;
+			for(size_t i = 0; i < cand.vertices.size(); i++)
 			{
-				MQPoint sp = scene->Convert3DToScreen(obj->GetVertex(*it));
-				if(sp.z < 0) continue;
+				const MQPoint& sp = cand.points[i];
 				float dis2 = (sp.x-clickpos.x)*(sp.x-clickpos.x) + (sp.y-clickpos.y)*(sp.y-clickpos.y);
 				if(mindist < dis2) continue;
-
+				if(mindist == dis2 && cand.vertices[i] < v) continue;
+				if(!visibility.IsVisible(sp,cand.object,&cand.vertices[i],1)) continue;
 				mindist = dis2;
-				picked_vertex.SetVertex(objenum.GetIndex(),*it);
+				v = cand.vertices[i];
 				camera_z = sp.z;
 			}
+			if(v != -1) picked_vertex.SetVertex(cand.object,v);
 		}
 		if(!picked_vertex.IsEmpty()) 
 		{
@@ -605,24 +4127,34 @@ void ExMovePlugin::pick_target(MQDocument doc, MQScene scene, POINT& mousepos, M
 
 	if(s_editoption.EditFace || s_editoption.EditLine)
 	{
+		// only the face in front under the cursor can be picked, and it is ranked in the loop below
+		// like any face without the buffer. -1 when faces are tested one by one
+		int front_object = -1, front_face = -1;
+		float front_z = 1.0f;
+		bool use_buffer = visibility.IsValid();
+		if(use_buffer && s_editoption.EditFace) visibility.GetFace(mousepos.x,mousepos.y,front_object,front_face,front_z);
+
 		// pick faces and lines
-		ObjectEnumerator objenum(doc);
-		for(MQObject obj = NULL; (obj = objenum.next()) != NULL;)
-		{
-			int o = objenum.GetIndex();
-			std::vector<int>& faces = m_cache_editable_faces[o];
-			std::vector< std::vector<int> >& edges = m_cache_edges[o];
-			
-			for(std::vector<int>::iterator it = faces.begin(); it != faces.end(); ++it)
+		for(size_t c = 0; c < m_pick_window.objects.size(); c++)
+		{
+			const std::vector<int>& faces = m_pick_window.objects[c].faces;
+			if(faces.empty()) continue;
+			PROFILE_COUNT(PROFILE_FACES_TESTED,(int)faces.size());
+
+			int o = m_pick_window.objects[c].object;
+			MQObject obj = doc->GetObject(o);
+			if(obj == NULL) continue;
+			ObjectCache& cache = get_object_cache(obj);
+			FaceEdgeTable& edges = cache.edges;
+			const FaceTriangulation& triangulation = get_triangulation(obj);
+			std::vector<MQPoint>& screen = cache.screen_positions;
+			if((int)screen.size() != obj->GetVertexCount()) continue;
+
+			for(std::vector<int>::const_iterator it = faces.begin(); it != faces.end(); ++it)
 			{
-				MQPoint t[4];
-				int vindices[4];
-				int pcount = obj->GetFacePointCount(*it);
-				obj->GetFacePointArray(*it,vindices);
-				t[0] = scene->Convert3DToScreen(obj->GetVertex(vindices[0]));
-				t[1] = scene->Convert3DToScreen(obj->GetVertex(vindices[1]));
-				if(pcount >= 3) t[2] = scene->Convert3DToScreen(obj->GetVertex(vindices[2]));
-				if(pcount == 4) t[3] = scene->Convert3DToScreen(obj->GetVertex(vindices[3]));
+				if(*it >= triangulation.GetFaceCount()) continue;
+				const int* vindices = triangulation.GetCorners(*it);
+				int pcount = triangulation.GetCornerCount(*it);
 
 				float z;
 
@@ -643,16 +4175,18 @@ void ExMovePlugin::pick_target(MQDocument doc, MQScene scene, POINT& mousepos, M
 				// lines
 				if(s_editoption.EditLine)
 				{
-					if(*it >= (int)edges.size()) {debuglog(doc,"edge cache error %d %d %d", o, *it, edges.size());continue;}
+					if(*it >= edges.GetFaceCount()) {debuglog(doc,"edge cache error %d %d %d", o, *it, edges.GetFaceCount());continue;}
 					bool docontinue = false;
-					std::vector<int>& e = edges[*it];
-					for(std::vector<int>::iterator eit = e.begin(); eit != e.end(); ++eit)
+					const int* e = edges.GetEdges(*it);
+					for(const int* eit = e; eit != e + edges.GetEdgeCount(*it); ++eit)
 					{
 						int v0 = *eit;
 						int v1 = (*eit+1)%pcount;
-						if(is_point_on_line_2d(clickpos,t[v0],t[v1])) 
+						const MQPoint& t0 = screen[vindices[v0]];
+						const MQPoint& t1 = screen[vindices[v1]];
+						if(is_point_on_line_2d(clickpos,t0,t1) && is_line_visible(visibility,o,clickpos,t0,t1,vindices[v0],vindices[v1])) 
 						{
-							z = min(t[v0].z, t[v1].z); 
+							z = min(t0.z, t1.z); 
 							if(z < picked_item_z)
 							{
 								picked_item.SetLine(o,*it,v0); 
@@ -671,32 +4205,26 @@ void ExMovePlugin::pick_target(MQDocument doc, MQScene scene, POINT& mousepos, M
 				}
 
 				if(pcount < 3) continue;
+				if(use_buffer && (o != front_object || *it != front_face)) continue;
 
-				// faces
+				// faces. the first triangle under the cursor gives the depth
 				if(s_editoption.EditFace)
 				{
-					if(is_point_in_triangle_2d(clickpos,t[0],t[1],t[2])) 
+					const int* tri = triangulation.GetTriangles(*it);
+					for(int k = 0; k < triangulation.GetTriangleCount(*it); k++, tri += 3)
 					{
-						z = min(min(t[0].z,t[1].z),t[2].z); 
+						const MQPoint& t0 = screen[vindices[tri[0]]];
+						const MQPoint& t1 = screen[vindices[tri[1]]];
+						const MQPoint& t2 = screen[vindices[tri[2]]];
+						if(!is_point_in_triangle_2d(clickpos,t0,t1,t2)) continue;
+
+						z = min(min(t0.z,t1.z),t2.z); 
 						if(z < picked_item_z)
 						{
 							picked_item.SetFace(o,*it); 
 							picked_item_z = z;
 						}
-						continue; 
-					}
-					if(pcount == 4)
-					{
-						if(is_point_in_triangle_2d(clickpos,t[0],t[2],t[3]))
-						{
-							z = min(min(t[0].z,t[2].z),t[3].z); 
-							if(z < picked_item_z)
-							{
-								picked_item.SetFace(o,*it); 
-								picked_item_z = z;
-							}
-							continue; 
-						}
+						break;
 					}
 				}
 			}
@@ -720,11 +4248,18 @@ BOOL ExMovePlugin::Activate(MQDocument doc, BOOL flag)
 {
 	m_highlightedelement.Reset();
 	m_moved = false;
+	m_pick_window.Reset();
+	m_hover_pending = false;
+	m_hover_redraw_pending = false;
+	m_region_polygon = false;
+	m_region_points.clear();
 
 	if(flag == TRUE)
 	{
 		this->GetEditOption(s_editoption);
-		m_cache_last_camera_pos.x = FLT_MAX;
+		m_cache_view_key = 0;
+		sweep_object_caches(doc);
+		for(int i = 0; i < m_objects.GetSlotCount(); i++) if(m_objects.GetSlot(i) != NULL) m_objects.GetSlot(i)->facing = FaceFacingCache();
 		refresh_edge_cache(doc);
 
 		char path[MAX_PATH];
@@ -736,11 +4271,44 @@ BOOL ExMovePlugin::Activate(MQDocument doc, BOOL flag)
 			m_color_highlight.b = (float)((col >> 16) & 0xff) / 255.0f;
 			m_color_highlight.g = (float)((col >> 8) & 0xff) / 255.0f;
 			m_color_highlight.r = (float)(col & 0xff) / 255.0f;
+
+			// 0 equal, 1 by area, 2 by angle
+			MQSetting plugin(path, "N-Move");
+			unsigned int weighting;
+			plugin.Load("NormalWeighting",weighting,(unsigned int)NORMAL_WEIGHT_EQUAL);
+			m_normal_weighting = (weighting <= NORMAL_WEIGHT_ANGLE) ? (int)weighting : NORMAL_WEIGHT_EQUAL;
+
+			// 0 selects through, 1 visible only
+			unsigned int visible_only;
+			plugin.Load("RegionVisibleOnly",visible_only,(unsigned int)0);
+			m_region_visible_only = (visible_only != 0);
+
+			// 0 rectangle, 1 lasso, 2 polygon
+			unsigned int shape;
+			plugin.Load("RegionShape",shape,(unsigned int)REGION_RECTANGLE);
+			m_region_shape = (shape <= REGION_POLYGON) ? (int)shape : REGION_RECTANGLE;
+
+			// 0 off, 1 within the radius in world space, 2 within the radius along edges
+			unsigned int soft;
+			plugin.Load("SoftSelection",soft,(unsigned int)SOFT_SELECTION_OFF);
+			m_soft_selection = (soft <= SOFT_SELECTION_GEODESIC) ? (int)soft : SOFT_SELECTION_OFF;
+			plugin.Load("SoftRadius",m_soft_radius,1.0f);
+
+			// 0 smooth, 1 linear
+			unsigned int falloff;
+			plugin.Load("SoftFalloff",falloff,(unsigned int)SOFT_FALLOFF_SMOOTH);
+			m_soft_falloff = (falloff <= SOFT_FALLOFF_LINEAR) ? (int)falloff : SOFT_FALLOFF_SMOOTH;
 		}
+		if(m_highlight_material != NULL && m_highlight_material_doc == doc) m_highlight_material->SetColor(m_color_highlight);
 
 	}
 	else
 	{
+		PROFILE_DUMP(doc);
+		m_highlight_geometry.clear();
+		if(m_highlight_material != NULL && m_highlight_material_doc == doc) DeleteDrawingMaterial(doc,m_highlight_material);
+		m_highlight_material = NULL;
+		m_highlight_material_doc = NULL;
 		RedrawAllScene();
 	}
 	
@@ -755,27 +4323,56 @@ BOOL ExMovePlugin::Activate(MQDocument doc, BOOL flag)
 //---------------------------------------------------------------------------
 BOOL ExMovePlugin::OnMouseMove(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state)
 {
+	PROFILE_SCOPE(PROFILE_MOUSEMOVE);
+
 	this->GetEditOption(s_editoption);
 
-	// do refresh_cache if the camera is moved. this is a bit tricky
-	if(m_cache_last_camera_pos != scene->GetCameraPosition())	
+	// the side of the polygon to the cursor follows it. nothing is picked meanwhile
+	if(m_region_polygon)
 	{
-		refresh_cache(doc,scene);
-		m_cache_last_camera_pos = scene->GetCameraPosition();
+		MQPoint cursor((float)state.MousePos.x,(float)state.MousePos.y,0.0001f);
+		draw_region_outline(doc,scene,&cursor);
+		RedrawScene(scene);
+		return FALSE;
+	}
+
+	// the highlight has changed and is not drawn yet. the last position is picked when it is.
+	// it is given up if the redraw does not come for a while
+	if(m_hover_redraw_pending && m_hover_scene == scene && GetTickCount() - m_hover_redraw_time < 100)
+	{
+		m_hover_pending = true;
+		m_hover_pos = state.MousePos;
+		return FALSE;
 	}
 
+	hover(doc,scene,state.MousePos,true);
+
+	// though we've done our own task, return FALSE for default one  
+	return FALSE;
+}
+
+void ExMovePlugin::hover(MQDocument doc, MQScene scene, POINT& mousepos, bool redraw)
+{
+	m_hover_pending = false;
+	m_hover_redraw_pending = false;
+
+	validate_cache(doc,scene);
+
 	MQSelectElement elmnew;
-	pick_target(doc,scene,state.MousePos,&elmnew);
+	pick_target(doc,scene,mousepos,&elmnew);
 
 	// redraw if the cursor is on a different vertex of previous tick 
 	if(m_highlightedelement != elmnew)
 	{
 		m_highlightedelement = elmnew;
-		RedrawScene(scene);
+		if(redraw)
+		{
+			m_hover_redraw_pending = true;
+			m_hover_scene = scene;
+			m_hover_redraw_time = GetTickCount();
+			RedrawScene(scene);
+		}
 	}
-
-	// though we've done our own task, return FALSE for default one  
-	return FALSE;
 }
 
 //---------------------------------------------------------------------------
@@ -785,46 +4382,50 @@ void ExMovePlugin::OnDraw(MQDocument doc, MQScene scene, int width, int height)
 {
 	// Notice : this is called even if we're not active
 
+	m_viewport_size[scene] = std::pair<int,int>(width,height);
+
+	// mouse moves held while waiting for this redraw
+	if(m_hover_redraw_pending && scene == m_hover_scene)
+	{
+		if(m_hover_pending) hover(doc,scene,m_hover_pos,false);
+		m_hover_redraw_pending = false;
+	}
+
 	if(m_highlightedelement.IsEmpty()) return;
 
 	MQObject obj = doc->GetObject(m_highlightedelement.GetObjectIndex());
 	if (obj == NULL) return; // it must not be, but check it.
 
+	// nothing is projected unless the highlight has changed
+	const HighlightGeometry& geometry = get_highlight_geometry(scene,obj);
+	int count = (int)geometry.points.size();
+	if(count == 0) return;
+
+	// the drawing object has to be made for each redraw. its vertices are for this scene only
+	int dindices[64];
+	std::vector<int> dindices_large;
+	int* di = dindices;
+	if(count > 64) { dindices_large.resize(count); di = &dindices_large[0]; }
+
 	// draw vertices highlighted 
 	switch(m_highlightedelement.GetType())
 	{
 	case SELEL_VERTEX:
 	{
-		// calcurate position of vertices
-		MQPoint sp = scene->Convert3DToScreen(obj->GetVertex(m_highlightedelement.GetVertexIndex()));
-		sp.z = 0.00001f;
-		MQPoint newvp = scene->ConvertScreenTo3D(sp); 
-
-		// create drawing object
-		int vertex[1];
 		MQObject draw = CreateDrawingObject(doc, DRAW_OBJECT_POINT);
 		draw->SetColor(m_color_highlight);
 		draw->SetColorValid(TRUE);
-		vertex[0] = draw->AddVertex(newvp);
-		draw->AddFace(1, vertex);
+		di[0] = draw->AddVertex(geometry.points[0]);
+		draw->AddFace(1, di);
 	}
 	break;
 
 	case SELEL_LINE:
 	{
-		int indices[5];
-		int pcount = obj->GetFacePointCount(m_highlightedelement.GetFaceIndex());
-		obj->GetFacePointArray(m_highlightedelement.GetFaceIndex(),indices);
-
-		int dindices[2];
 		MQObject dobj = CreateDrawingObject(doc, DRAW_OBJECT_LINE);
-
-		MQPoint ptmp = scene->Convert3DToScreen(obj->GetVertex(indices[m_highlightedelement.GetLineIndex()])); ptmp.z = 0.00001f;
-		dindices[0] = dobj->AddVertex(scene->ConvertScreenTo3D(ptmp));
-		ptmp = scene->Convert3DToScreen(obj->GetVertex(indices[(m_highlightedelement.GetLineIndex()+1)%pcount])); ptmp.z = 0.00001f;
-		dindices[1] = dobj->AddVertex(scene->ConvertScreenTo3D(ptmp));
-
-		dobj->AddFace(2,dindices);
+		di[0] = dobj->AddVertex(geometry.points[0]);
+		di[1] = dobj->AddVertex(geometry.points[1]);
+		dobj->AddFace(2,di);
 		dobj->SetColor(m_color_highlight);
 		dobj->SetColorValid(TRUE);
 	}
@@ -832,22 +4433,90 @@ void ExMovePlugin::OnDraw(MQDocument doc, MQScene scene, int width, int height)
 
 	case SELEL_FACE:
 	{
-		int indices[5];
-		int pcount = obj->GetFacePointCount(m_highlightedelement.GetFaceIndex());
-		obj->GetFacePointArray(m_highlightedelement.GetFaceIndex(),indices);
-
-		int dindices[5];
+		// in the triangles picking has used, so that a concave face is covered as it is
 		MQObject dobj = CreateDrawingObject(doc, DRAW_OBJECT_FACE);
+		for(int i = 0; i < count; i++) di[i] = dobj->AddVertex(geometry.points[i]);
+		int material = get_highlight_material(doc);
+		for(size_t t = 0; t + 2 < geometry.triangles.size(); t += 3)
+		{
+			int tri[3] = { di[geometry.triangles[t]], di[geometry.triangles[t+1]], di[geometry.triangles[t+2]] };
+			int face = dobj->AddFace(3,tri);
+			dobj->SetFaceMaterial(face,material);
+		}
+	}
+	break;
+	}
+}
 
-		for(int i = 0; i < pcount; i++)
+const HighlightGeometry& ExMovePlugin::get_highlight_geometry(MQScene scene, MQObject obj)
+{
+	// the view can only be told by the key. the object tells of its own changes by the versions of its cache,
+	// so that nothing of it is read while the highlight stays
+	HighlightGeometry& geometry = m_highlight_geometry[scene];
+	unsigned int key = get_view_key(scene);
+	UINT id = (UINT)obj->GetUniqueID();
+	const ObjectCache& cache = get_object_cache(obj);
+	if(geometry.element == m_highlightedelement && geometry.view_key == key && geometry.object_id == id &&
+		geometry.topology_version == cache.topology.version && geometry.vertex_version == cache.vertex_version) return geometry;
+
+	geometry.element = m_highlightedelement;
+	geometry.view_key = key;
+	geometry.object_id = id;
+	geometry.topology_version = cache.topology.version;
+	geometry.vertex_version = cache.vertex_version;
+
+	// vertices of the element in drawing order
+	std::vector<int>& indices = geometry.indices;
+	indices.clear();
+	switch(m_highlightedelement.GetType())
+	{
+	case SELEL_VERTEX:
+		indices.push_back(m_highlightedelement.GetVertexIndex());
+		break;
+	case SELEL_LINE:
+	case SELEL_FACE:
+	{
+		int f = m_highlightedelement.GetFaceIndex();
+		int pcount = obj->GetFacePointCount(f);
+		if(pcount == 0) break;
+		indices.resize(pcount);
+		obj->GetFacePointArray(f,&indices[0]);
+		if(m_highlightedelement.GetType() == SELEL_LINE)
 		{
-			MQPoint ptmp = scene->Convert3DToScreen(obj->GetVertex(indices[i]));
-			ptmp.z = 0.00001f;
-			dindices[i] = dobj->AddVertex(scene->ConvertScreenTo3D(ptmp));
+			int l = m_highlightedelement.GetLineIndex();
+			int v0 = indices[l], v1 = indices[(l+1)%pcount];
+			indices.resize(2);
+			indices[0] = v0;
+			indices[1] = v1;
 		}
-		dobj->AddFace(pcount,dindices);
-		int dmatindex;
-		MQMaterial dmat = CreateDrawingMaterial(doc,dmatindex);
+	}
+	break;
+	}
+
+	// brought onto the near plane, so that it is drawn over everything
+	geometry.points.resize(indices.size());
+	geometry.triangles.clear();
+	if(m_highlightedelement.GetType() == SELEL_FACE && !indices.empty())
+	{
+		const FaceTriangulation& triangulation = get_triangulation(obj);
+		int f = m_highlightedelement.GetFaceIndex();
+		if(f < triangulation.GetFaceCount()) geometry.triangles.assign(triangulation.GetTriangles(f),triangulation.GetTriangles(f) + triangulation.GetTriangleCount(f) * 3);
+	}
+	for(size_t i = 0; i < indices.size(); i++)
+	{
+		MQPoint sp = scene->Convert3DToScreen(obj->GetVertex(indices[i]));
+		sp.z = 0.00001f;
+		geometry.points[i] = scene->ConvertScreenTo3D(sp);
+	}
+	return geometry;
+}
+
+int ExMovePlugin::get_highlight_material(MQDocument doc)
+{
+	// kept until the plugin is deactivated. the one of a closed document has gone with it
+	if(m_highlight_material == NULL || m_highlight_material_doc != doc)
+	{
+		MQMaterial dmat = CreateDrawingMaterial(doc,m_highlight_material_index,FALSE);
 		dmat->SetAlpha(0.5f);
 		dmat->SetAmbient(0);
 		dmat->SetDiffuse(0);
@@ -856,10 +4525,10 @@ void ExMovePlugin::OnDraw(MQDocument doc, MQScene scene, int width, int height)
 		dmat->SetSpecular(0);
 		dmat->SetShader(MQMATERIAL_SHADER_CLASSIC);
 		dmat->SetColor(m_color_highlight);
-		dobj->SetFaceMaterial(0,dmatindex);
-	}
-	break;
+		m_highlight_material = dmat;
+		m_highlight_material_doc = doc;
 	}
+	return m_highlight_material_index;
 }
 
 
@@ -872,7 +4541,36 @@ BOOL ExMovePlugin::OnLeftButtonDown(MQDocument doc, MQScene scene, MOUSE_BUTTON_
 {
 	m_regional_select_mode = false;
 	m_moved = false;
-	m_normalmap.clear();
+	m_drag.Clear();
+	m_drag_mode = 0;
+	m_hover_pending = false;
+	m_hover_redraw_pending = false;
+
+	// clicks go to the polygon until it is closed. on its first corner it is
+	if(m_region_polygon)
+	{
+		// nothing is toggled or dragged by these clicks
+		m_togglereserve.Reset();
+		m_selection.clear();
+		m_symmetry.clear();
+
+		MQPoint p((float)state.MousePos.x,(float)state.MousePos.y,0.0001f);
+		const MQPoint& first = m_region_points.front();
+		float dx = p.x - first.x, dy = p.y - first.y;
+		if(m_region_points.size() >= 3 && dx * dx + dy * dy <= THRESHOLD_PICK_POINT * THRESHOLD_PICK_POINT)
+		{
+			close_region_polygon(doc,scene,state);
+		}
+		else
+		{
+			m_region_points.push_back(p);
+			draw_region_outline(doc,scene,NULL);
+			RedrawScene(scene);
+		}
+		return TRUE;
+	}
+
+	validate_cache(doc,scene);
 
 	MQSelectElement elm;
 	pick_target(doc,scene,state.MousePos,&elm);
@@ -881,7 +4579,9 @@ BOOL ExMovePlugin::OnLeftButtonDown(MQDocument doc, MQScene scene, MOUSE_BUTTON_
 	
 	if(elm.IsEmpty()) 
 	{// clicked nothing
-		m_regional_select_mode = true;
+		m_region_points.assign(1,MQPoint((float)state.MousePos.x,(float)state.MousePos.y,0.0001f));
+		if(m_region_shape == REGION_POLYGON) m_region_polygon = true;
+		else m_regional_select_mode = true;
 	}
 	else
 	{// clicked something
@@ -906,6 +4606,10 @@ BOOL ExMovePlugin::OnLeftButtonDown(MQDocument doc, MQScene scene, MOUSE_BUTTON_
 	m_symmetry.clear();
 	get_selection(doc,scene,m_selection);
 	get_symmetry_vertices(doc,m_selection,m_symmetry);
+	// soft selection goes with dragging only. region selection starts from nothing clicked
+	std::vector<FalloffVertex> falloff;
+	if(!elm.IsEmpty()) get_falloff_vertices(doc,falloff);
+	m_drag.Begin(doc,m_selection,m_symmetry,&falloff);
 	
 	MQPoint p = elm.GetPoint(doc);
 	m_sc_dragbegin_z = scene->Convert3DToScreen(p).z;
@@ -924,6 +4628,29 @@ BOOL ExMovePlugin::OnLeftButtonDown(MQDocument doc, MQScene scene, MOUSE_BUTTON_
 //---------------------------------------------------------------------------
 BOOL ExMovePlugin::OnLeftButtonMove(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state)
 {
+	PROFILE_SCOPE(PROFILE_DRAG);
+
+	// a polygon gets its corners by clicks. the button held between them does nothing
+	if(m_region_polygon)
+	{
+		MQPoint cursor((float)state.MousePos.x,(float)state.MousePos.y,0.0001f);
+		draw_region_outline(doc,scene,&cursor);
+		RedrawScene(scene);
+		return TRUE;
+	}
+
+	// lasso. points closer than a few pixels to the last one add nothing to the mask
+	if(m_regional_select_mode && m_region_shape == REGION_LASSO)
+	{
+		MQPoint mousepos((float)state.MousePos.x,(float)state.MousePos.y,0.0001f);
+		const MQPoint& last = m_region_points.back();
+		float dx = mousepos.x - last.x, dy = mousepos.y - last.y;
+		if(dx * dx + dy * dy >= 4.0f) m_region_points.push_back(mousepos);
+		draw_region_outline(doc,scene,NULL);
+		RedrawScene(scene);
+		return TRUE;
+	}
+
 	// region selection mode
 	if(m_regional_select_mode)
 	{
@@ -975,32 +4702,29 @@ BOOL ExMovePlugin::OnLeftButtonMove(MQDocument doc, MQScene scene, MOUSE_BUTTON_
 		if(marge_vertices(doc,scene) == TRUE)
 		{
 			m_selection.clear();
+			m_drag.Clear();
 			m_highlightedelement.Reset();
 			RedrawAllScene();
 			return TRUE;
 		}
 	}
 
+	// switching the kind of move. it goes on from where the vertices are now
+	int mode = (state.Alt == TRUE) ? 1 : 2;
+	if(mode != m_drag_mode)
+	{
+		if(m_drag_mode != 0) m_drag.Rebase(doc);
+		m_drag_mode = mode;
+		if(mode == 1) m_drag_origin = m_mouse_drag;
+		else { m_drag_origin = m_mouse_drag_ignorey; m_drag_origin_x = m_mouse_sc_drag_x; }
+	}
+
 	// a standerd move
 	if(state.Alt == TRUE)
 	{
 		MQPoint current_scene_mouse = scene->ConvertScreenTo3D(MQPoint((float)state.MousePos.x, (float)state.MousePos.y, m_sc_dragbegin_z));
-		MQPoint delta  = (current_scene_mouse - m_mouse_drag);
-	
-		for(std::vector<MQSelectVertex>::iterator it = m_selection.begin(); it != m_selection.end(); ++it)
-		{
-			MQObject obj = doc->GetObject(it->object);
-			MQPoint ipos = obj->GetVertex(it->vertex);
-			obj->SetVertex(it->vertex, ipos + delta);
-		}
-
-		delta.x = -delta.x;
-		for(std::vector<MQSelectVertex>::iterator it = m_symmetry.begin(); it != m_symmetry.end(); ++it)
-		{
-			MQObject obj = doc->GetObject(it->object);
-			MQPoint ipos = obj->GetVertex(it->vertex);
-			obj->SetVertex(it->vertex, ipos + delta);
-		}
+		m_drag.Translate(doc,current_scene_mouse - m_drag_origin);
+		grow_bounds(doc);
 
 		m_mouse_drag = current_scene_mouse;
 
@@ -1012,39 +4736,39 @@ BOOL ExMovePlugin::OnLeftButtonMove(MQDocument doc, MQScene scene, MOUSE_BUTTON_
 	// normal aligned move ////////////////////////////////
 
 	// initialization
-	if(m_normalmap.size() == 0)
+	if(!m_drag.HasNormals())
 	{
-		// normalmap creation
-		for(std::vector<MQSelectVertex>::iterator it = m_selection.begin(); it != m_selection.end(); ++it)
+		// one pass for each object. faces around the vertices may have been moved in this drag already
+		std::vector<MQPoint> normals(m_drag.GetCount());
+		std::vector<int> vertices;
+		for(int g = 0; g < m_drag.GetGroupCount(); g++)
 		{
-			MQPoint n(0,0,0);
-			get_vertex_disignated_normal(doc,*it,&n);
-			m_normalmap[*it] = n;
-		}
-		for(std::vector<MQSelectVertex>::iterator it = m_symmetry.begin(); it != m_symmetry.end(); ++it)
-		{
-			MQPoint n(0,0,0);
-			get_vertex_disignated_normal(doc,*it,&n);
-			m_normalmap[*it] = n;
+			int o = m_drag.GetGroupObject(g);
+			MQObject obj = doc->GetObject(o);
+			if(obj == NULL) continue;
+			const VertexFaceAdjacency& adjacency = get_adjacency(doc,o);
+			FaceNormalCache& cache = get_object_cache(obj).normals;
+			cache.Resize(obj->GetFaceCount());
+
+			int begin = m_drag.GetGroupBegin(g), end = m_drag.GetGroupBegin(g + 1);
+			vertices.clear();
+			for(int i = begin; i < end; i++)
+			{
+				vertices.push_back(m_drag.GetVertex(i).vertex);
+				cache.MarkVertexDirty(adjacency,m_drag.GetVertex(i).vertex);
+			}
+			get_vertex_normals(obj,adjacency,cache,m_normal_weighting,&vertices[0],end - begin,&normals[begin]);
 		}
+		m_drag.SetNormals(normals);
 	}
 
+	// the mouse moves along a line on the screen, so the distance from the origin is the sum of every step
 	MQPoint current_scene_mouse = scene->ConvertScreenTo3D(MQPoint((float)state.MousePos.x,0,m_sc_dragbegin_z));	
-	float dist = (current_scene_mouse - m_mouse_drag_ignorey).abs();
-	if(state.MousePos.x - m_mouse_sc_drag_x < 0) dist = -dist;
+	float dist = (current_scene_mouse - m_drag_origin).abs();
+	if(state.MousePos.x - m_drag_origin_x < 0) dist = -dist;
 	
-	for(std::vector<MQSelectVertex>::iterator it = m_selection.begin(); it != m_selection.end(); ++it)
-	{
-		MQObject obj = doc->GetObject(it->object);
-		MQPoint ipos = obj->GetVertex(it->vertex);
-		obj->SetVertex(it->vertex, ipos + (m_normalmap[*it] * dist));
-	}
-	for(std::vector<MQSelectVertex>::iterator it = m_symmetry.begin(); it != m_symmetry.end(); ++it)
-	{
-		MQObject obj = doc->GetObject(it->object);
-		MQPoint ipos = obj->GetVertex(it->vertex);
-		obj->SetVertex(it->vertex, ipos + (m_normalmap[*it] * dist));
-	}
+	m_drag.MoveAlongNormals(doc,dist);
+	grow_bounds(doc);
 
 	m_mouse_sc_drag_x = state.MousePos.x;
 	m_mouse_drag_ignorey = current_scene_mouse;
@@ -1057,52 +4781,118 @@ BOOL ExMovePlugin::OnLeftButtonMove(MQDocument doc, MQScene scene, MOUSE_BUTTON_
 
 void ExMovePlugin::regional_select(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state)
 {
+	PROFILE_SCOPE(PROFILE_REGIONAL_SELECT);
+
 	if(state.Shift == FALSE) doc->ClearSelect(MQDOC_CLEARSELECT_ALL);
 
 	float r,l,b,t;
 
-	r = max(m_mouse_sc_dragbegin.x,state.MousePos.x);
-	l = min(m_mouse_sc_dragbegin.x,state.MousePos.x);
-	t = max(m_mouse_sc_dragbegin.y,state.MousePos.y);
-	b = min(m_mouse_sc_dragbegin.y,state.MousePos.y);
+	// a lasso or polygon is rasterized once. its bounding box goes through the same tests as a rectangle,
+	// and only points inside the box look up the mask
+	const ScreenMask* mask = NULL;
+	if(m_region_shape != REGION_RECTANGLE)
+	{
+		m_region_mask.Rasterize(m_region_points);
+		if(m_region_mask.IsEmpty()) return;
+		m_region_mask.GetBounds(l,r,b,t);
+		mask = &m_region_mask;
+	}
+	else
+	{
+		r = max(m_mouse_sc_dragbegin.x,state.MousePos.x);
+		l = min(m_mouse_sc_dragbegin.x,state.MousePos.x);
+		t = max(m_mouse_sc_dragbegin.y,state.MousePos.y);
+		b = min(m_mouse_sc_dragbegin.y,state.MousePos.y);
+	}
+
+	validate_cache(doc,scene);
+
+	bool select_edges = s_editoption.EditFace || s_editoption.EditLine;
 
+	// what is behind faces in this view is left out when asked
+	const VisibilityBuffer* visibility = NULL;
+	if(m_region_visible_only)
+	{
+		visibility = &get_visibility(doc,scene);
+		if(!visibility->IsValid()) visibility = NULL;
+	}
+
+	// everything needed from the document is read here, on this thread
+	std::vector<RegionSelectJob> jobs;
 	ObjectEnumerator objenum(doc);
 	for(MQObject obj = NULL; (obj = objenum.next()) != NULL;)
 	{
-		int vcount = obj->GetVertexCount();
-		std::set<int> vertex_to_select;
-		for(int v = 0; v < vcount; v++)
-		{
-			if(obj->GetVertexRefCount(v) == 0) continue;
+		int o = objenum.GetIndex();
 
-			MQPoint p = scene->Convert3DToScreen(obj->GetVertex(v));
-			if(r < p.x || l > p.x) continue;
-			if(t < p.y || b > p.y) continue;
+		// nothing of an object out of the rectangle can be inside
+		float bl, br, bb, bt;
+		if(get_screen_bounds(scene,obj,bl,br,bb,bt) && (br < l || r < bl || bt < b || t < bb)) continue;
+
+		ObjectCache& cache = get_object_cache(obj);
+		std::vector<MQPoint>& screen = cache.screen_positions;
+		if(cache.view_stamp != m_view_stamp || (int)screen.size() != obj->GetVertexCount()) project_vertices(scene,m_projection,obj,screen);
+
+		jobs.push_back(RegionSelectJob());
+		RegionSelectJob& job = jobs.back();
+		job.object = o;
+		job.screen = &screen;
+		job.adjacency = &get_adjacency(doc,o);
+		job.edges = &cache.edges;
+		job.visibility = visibility;
+		job.mask = mask;
+		job.inside.resize((screen.size() + 31) / 32);
+		if(select_edges && job.edges->GetTotalEdgeCount() > 0 && !screen.empty()) job.edge_inside.resize((job.edges->GetTotalEdgeCount() + 31) / 32);
+	}
 
-			doc->AddSelectVertex(objenum.GetIndex(),v);
-			vertex_to_select.insert(v);
-		}
+	// huge objects are split into chunks. a multiple of 32
+	const int chunk = 65536;
+	std::vector<RegionVertexTask> vtasks;
+	std::vector<RegionEdgeTask> etasks;
+	for(size_t j = 0; j < jobs.size(); j++)
+	{
+		int vcount = (int)jobs[j].screen->size();
+		for(int begin = 0; begin < vcount; begin += chunk) vtasks.push_back(RegionVertexTask(&jobs[j],begin,min(begin + chunk,vcount),l,r,b,t));
+		int ecount = jobs[j].edge_inside.empty() ? 0 : jobs[j].edges->GetTotalEdgeCount();
+		for(int begin = 0; begin < ecount; begin += chunk) etasks.push_back(RegionEdgeTask(&jobs[j],begin,min(begin + chunk,ecount)));
+	}
 
-		if(s_editoption.EditFace || s_editoption.EditLine)
+	std::vector<WorkerTask*> tasks;
+	for(size_t i = 0; i < vtasks.size(); i++) tasks.push_back(&vtasks[i]);
+	s_workers.Run(tasks);
+
+	// edges need all vertices of their object
+	tasks.clear();
+	for(size_t i = 0; i < etasks.size(); i++) tasks.push_back(&etasks[i]);
+	s_workers.Run(tasks);
+
+	// the document is touched serially, in the same order as before. empty words are skipped
+	for(size_t j = 0; j < jobs.size(); j++)
+	{
+		RegionSelectJob& job = jobs[j];
+		for(int w = 0; w < (int)job.inside.size(); w++)
 		{
-			// search a edge having both vertices are selected
-			std::vector< std::vector<int> >& edges = m_cache_edges[objenum.GetIndex()];
+			unsigned int bits = job.inside[w];
+			for(int k = 0; bits != 0; k++, bits >>= 1)
+			{
+				if(bits & 1) doc->AddSelectVertex(job.object,(w << 5) + k);
+			}
+		}
 
-			int fcount = obj->GetFaceCount();
-			for(int f = 0; f < fcount; f++)
+		if(job.edge_inside.empty()) continue;
+
+		// edges having both vertices selected. faces are followed along as edges go up
+		const FaceEdgeTable& edges = *job.edges;
+		int fcount = edges.GetFaceCount();
+		int f = 0;
+		for(int w = 0; w < (int)job.edge_inside.size(); w++)
+		{
+			unsigned int bits = job.edge_inside[w];
+			for(int k = 0; bits != 0; k++, bits >>= 1)
 			{
-				int indices[4];
-				obj->GetFacePointArray(f,indices);
-				int pcount = obj->GetFacePointCount(f);
-				std::vector<int>& e = edges[f];
-				for(std::vector<int>::iterator it = e.begin(); it != e.end(); ++it)
-				{
-					if(vertex_to_select.find(indices[*it]) != vertex_to_select.end() &&
-						vertex_to_select.find(indices[(*it+1)%pcount]) != vertex_to_select.end())
-					{
-						doc->AddSelectLine(objenum.GetIndex(),f,*it);
-					}
-				}
+				if((bits & 1) == 0) continue;
+				int e = (w << 5) + k;
+				while(f + 1 < fcount && edges.GetFirstEdge(f + 1) <= e) f++;
+				doc->AddSelectLine(job.object,f,edges.GetEdges(f)[e - edges.GetFirstEdge(f)]);
 			}
 		}
 	}
@@ -1113,16 +4903,43 @@ void ExMovePlugin::regional_select(MQDocument doc, MQScene scene, MOUSE_BUTTON_S
 //---------------------------------------------------------------------------
 BOOL ExMovePlugin::OnLeftButtonUp(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state)
 {
+	// the polygon takes more clicks
+	if(m_region_polygon) return TRUE;
+
 	// region selection mode
 	if(m_regional_select_mode)
 	{
+		if(m_region_shape == REGION_LASSO) m_region_points.push_back(MQPoint((float)state.MousePos.x,(float)state.MousePos.y,0.0001f));
 		regional_select(doc,scene,state);
+		m_region_points.clear();
 		RedrawAllScene();
 		return TRUE;
 	}
 
 	if(m_moved)
 	{
+		// vertex positions are changed. caches of touched objects which depend on them have to be made again.
+		// the drag has every moved vertex, soft ones too
+		for(int g = 0; g < m_drag.GetGroupCount(); g++)
+		{
+			int o = m_drag.GetGroupObject(g);
+			MQObject obj = doc->GetObject(o);
+			if(obj == NULL) continue;
+			ObjectCache& cache = get_object_cache(obj);
+			cache.spatial.Clear();
+			cache.falloff.Clear();
+			cache.bvh.MarkDirty();
+			const VertexFaceAdjacency& adjacency = get_adjacency(doc,o);
+			for(int i = m_drag.GetGroupBegin(g); i < m_drag.GetGroupBegin(g+1); i++) cache.normals.MarkVertexDirty(adjacency,m_drag.GetVertex(i).vertex);
+			// boxes have only grown on the way. made tight again
+			cache.bounds.valid = false;
+			// so are projected positions. other objects keep theirs
+			if(cache.view_stamp == 0) continue;
+			cache.facing = FaceFacingCache();
+			cache.view_stamp = 0;
+		}
+		m_cache_objects_changed = true;
+
 		// redraw and update undo if moved 
 		RedrawAllScene();
 		UpdateUndo();
@@ -1146,62 +4963,200 @@ BOOL ExMovePlugin::OnLeftButtonUp(MQDocument doc, MQScene scene, MOUSE_BUTTON_ST
 
 BOOL ExMovePlugin::OnRightButtonDown(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state)
 {
+	// closes the polygon being clicked. one with less than 3 corners is just given up
+	if(m_region_polygon)
+	{
+		close_region_polygon(doc,scene,state);
+		return TRUE;
+	}
 	return FALSE;
 }
 
-BOOL ExMovePlugin::marge_vertices(MQDocument doc, MQScene scene)
+void ExMovePlugin::close_region_polygon(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state)
+{
+	m_region_polygon = false;
+	if(m_region_points.size() >= 3) regional_select(doc,scene,state);
+	m_region_points.clear();
+	RedrawAllScene();
+}
+
+// lines through the lasso or polygon corners on the near plane, closed back to the first one. the cursor is one more corner if given
+void ExMovePlugin::draw_region_outline(MQDocument doc, MQScene scene, const MQPoint* cursor)
 {
-	if(m_selection.size() != 1) return FALSE;
+	int count = (int)m_region_points.size() + (cursor != NULL ? 1 : 0);
+	if(count < 2) return;
 
-	MQSelectVertex sv = *m_selection.begin();
-	MQObject obj = doc->GetObject(sv.object);
-	if(obj == NULL) return FALSE;
+	MQObject dobj = CreateDrawingObject(doc, DRAW_OBJECT_LINE);
+	std::vector<int> indices(count);
+	for(int i = 0; i < (int)m_region_points.size(); i++) indices[i] = dobj->AddVertex(scene->ConvertScreenTo3D(m_region_points[i]));
+	if(cursor != NULL) indices[count - 1] = dobj->AddVertex(scene->ConvertScreenTo3D(*cursor));
+
+	// two corners are a single line
+	int lines = (count == 2) ? 1 : count;
+	for(int i = 0; i < lines; i++)
+	{
+		int line[2] = { indices[i], indices[(i + 1) % count] };
+		dobj->AddFace(2,line);
+	}
 
-	MQPoint pbase(scene->Convert3DToScreen(obj->GetVertex(sv.vertex)));
-	pbase.z = 0;
+	dobj->SetColor(MQColor(1,1,1));
+	dobj->SetColorValid(TRUE);
+}
 
-	// search neighbor
-	int vcount = obj->GetVertexCount();
-	float minlen = 15.0f * 15.0f;
-	int vneighbor = -1;
-	for(int v = 0; v < vcount; v++)
+// union-find over vertex indices. roots are what the others are welded onto
+class WeldGroups
+{
+public:
+	void Reset(int count)
+	{
+		m_parent.resize(count);
+		for(int v = 0; v < count; v++) m_parent[v] = v;
+	}
+
+	int Find(int v)
 	{
-		if(v == sv.vertex) continue;
-		if(obj->GetVertexRefCount(v) == 0) continue;
-		MQPoint p(scene->Convert3DToScreen(obj->GetVertex(v)));
-		p.z = 0;
-		float len = (p - pbase).norm();
-		if(len < minlen)
+		while(m_parent[v] != v)
 		{
-			vneighbor = v;
-			minlen = len;
+			m_parent[v] = m_parent[m_parent[v]];
+			v = m_parent[v];
 		}
+		return v;
+	}
+
+	// the group of v goes to the root of target
+	void Weld(int v, int target)
+	{
+		int rv = Find(v), rt = Find(target);
+		if(rv != rt) m_parent[rv] = rt;
 	}
 
-	if(vneighbor == -1) return TRUE;
+private:
+	std::vector<int> m_parent;
+};
+
+// every selected vertex is welded onto the nearest vertex out of the selection within 15 pixels on the screen.
+// vertices welded onto the same one are merged together, and all faces around them are rebuilt at once
+// TRUE when any vertex has been welded. the drag goes on otherwise
+BOOL ExMovePlugin::marge_vertices(MQDocument doc, MQScene scene)
+{
+	if(m_selection.empty()) return FALSE;
 
-	std::vector<int> findices;
-	find_faces_contains_vertex(obj,sv.vertex,findices);
+	const float radius = 15.0f;
+	BOOL merged = FALSE;
 
-	for(std::vector<int>::iterator it = findices.begin(); it != findices.end(); ++it)
+	// m_selection is sorted by object
+	std::vector<MQSelectVertex>::iterator group = m_selection.begin();
+	while(group != m_selection.end())
 	{
-		int indices[5];
-		int newindices[5];
-		int pcount = obj->GetFacePointCount(*it);
-		obj->GetFacePointArray(*it,indices);
-		int mat = obj->GetFaceMaterial(*it);
-		obj->DeleteFace(*it,false);
-		int newi = 0;
-		for(int i = 0; i < pcount; i++) if(indices[i] != vneighbor) { newindices[newi] = indices[i]; newi++; }
-		if(newi < 3) continue;
-		for(int i = 0; i < newi; i++) if(newindices[i] == sv.vertex) newindices[i] = vneighbor;
-		int newf = obj->AddFace(newi,newindices);
-		obj->SetFaceMaterial(newf,mat);
-	}
+		int o = group->object;
+		std::vector<MQSelectVertex>::iterator next = group;
+		while(next != m_selection.end() && next->object == o) ++next;
 
-	m_moved = true;
+		MQObject obj = doc->GetObject(o);
+		if(obj == NULL) { group = next; continue; }
 
-	return TRUE;
+		// vertices are being dragged. project the object again
+		std::vector<MQPoint>& screen = get_object_cache(obj).screen_positions;
+		project_vertices(scene,m_projection,obj,screen);
+
+		const VertexFaceAdjacency& adjacency = get_adjacency(doc,o);
+		int vcount = obj->GetVertexCount();
+
+		std::vector<unsigned char> selected(vcount, 0);
+		for(std::vector<MQSelectVertex>::iterator it = group; it != next; ++it) if(it->vertex >= 0 && it->vertex < (int)selected.size()) selected[it->vertex] = 1;
+
+		// the rest of the object is what they are welded onto
+		std::vector<int> targets;
+		std::vector<MQPoint> tpoints;
+		for(size_t v = 0; v < selected.size(); v++)
+		{
+			if(selected[v] || adjacency.GetFaceCount((int)v) == 0) continue;
+			targets.push_back((int)v);
+			tpoints.push_back(screen[v]);
+		}
+		ScreenPointGrid grid;
+		grid.Build(targets,tpoints,radius);
+
+		WeldGroups groups;
+		groups.Reset(vcount);
+		std::vector<int> welded;
+		for(std::vector<MQSelectVertex>::iterator it = group; it != next; ++it)
+		{
+			int v = it->vertex;
+			if(v >= vcount) continue;
+			MQPoint p(screen[v]);
+			float mindist = radius * radius;
+			int neighbor = -1;
+			float z;
+			if(!grid.FindNearest(p,radius,mindist,neighbor,z) || !(mindist < radius * radius)) continue;
+			groups.Weld(v,neighbor);
+			welded.push_back(v);
+		}
+		group = next;
+
+		if(welded.empty()) continue;
+
+		// faces around welded vertices, in ascending order
+		std::vector<int> findices;
+		for(size_t i = 0; i < welded.size(); i++)
+		{
+			findices.insert(findices.end(),adjacency.GetFaces(welded[i]),adjacency.GetFaces(welded[i]) + adjacency.GetFaceCount(welded[i]));
+		}
+		std::sort(findices.begin(),findices.end());
+		findices.erase(std::unique(findices.begin(),findices.end()),findices.end());
+
+		std::vector<int> removed;
+		std::vector< std::vector<int> > removed_corners;
+		std::vector<int> added;
+
+		std::vector<int> indices, mapped, newindices;
+		for(std::vector<int>::iterator it = findices.begin(); it != findices.end(); ++it)
+		{
+			int pcount = obj->GetFacePointCount(*it);
+			if(pcount == 0) continue;
+			indices.resize(pcount);
+			obj->GetFacePointArray(*it,&indices[0]);
+			int mat = obj->GetFaceMaterial(*it);
+			obj->DeleteFace(*it,false);
+			removed.push_back(*it);
+			removed_corners.push_back(indices);
+
+			mapped.resize(pcount);
+			for(int i = 0; i < pcount; i++) mapped[i] = groups.Find(indices[i]);
+
+			// a vertex welded onto another of the same face takes its place. the one welded onto is dropped
+			newindices.clear();
+			for(int i = 0; i < pcount; i++)
+			{
+				bool dropped = false;
+				if(mapped[i] == indices[i])
+				{
+					for(int j = 0; j < pcount && !dropped; j++) dropped = (mapped[j] == indices[i] && indices[j] != indices[i]);
+				}
+				if(dropped) continue;
+				if(std::find(newindices.begin(),newindices.end(),mapped[i]) != newindices.end()) continue;
+				newindices.push_back(mapped[i]);
+			}
+			if(newindices.size() < 3) continue;
+			int newf = obj->AddFace((int)newindices.size(),&newindices[0]);
+			obj->SetFaceMaterial(newf,mat);
+			added.push_back(newf);
+		}
+
+		// topology has changed locally. patch edges and adjacency around the touched faces
+		patch_topology(obj,o,removed,removed_corners,added);
+		ObjectCache& cache = get_object_cache(obj);
+		cache.spatial.Clear();
+		cache.falloff.Clear();
+		cache.facing = FaceFacingCache();
+		cache.view_stamp = 0;
+		m_cache_objects_changed = true;
+
+		m_moved = true;
+		merged = TRUE;
+	}
+
+	return merged;
 }
 
 
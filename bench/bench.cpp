@@ -0,0 +1,604 @@
+// Benchmark of the ExMove hot paths on the in-memory SDK stand-in.
+// the plugin is driven through its event handlers as Metasequoia would, and every call is timed.
+// which handler reaches which part of the plugin:
+//   Activate, OnObjectModified        refresh_edge_cache
+//   a view change and a mouse move    refresh_cache, then pick_target
+//   OnMouseMove and OnDraw            pick_target and the highlight
+//   OnLeftButtonDown on a selection   get_selection and the start of a drag
+//   OnLeftButtonMove while dragging   the drag
+//   OnLeftButtonUp after a box drag   regional_select
+// built with EXMOVE_PROFILE, the plugin also dumps its own timings of those functions on deactivation
+// (to stderr with --verbose, and as json to the file EXMOVE_PROFILE_FILE names).
+//
+// with --sweep-threads, the calls that run on the worker pool are timed with 1, 2, ... processors reported.
+//
+// with --dump, picks and selections are printed instead of timings. two builds of ExMove.cpp given the
+// same options should print the same, up to the rounding of where the vertices go, which is what "make compare" checks.
+#include <windows.h>
+#include "MQBasePlugin.h"
+#include "MQStandIn.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <string>
+#include <set>
+#include <algorithm>
+
+typedef MQCommandPlugin::MOUSE_BUTTON_STATE MouseState;
+
+struct Options
+{
+	int grid;
+	int sphere;
+	std::vector<std::string> meshes;
+	int objects;
+	int iterations;
+	int threads;
+	int sweep_threads;
+	int width, height;
+	float head, pitch;
+	bool dump;
+	bool verbose;
+};
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: exmove_bench [options]\n"
+		"  --grid N          N x N quads (default 700 when no other mesh is given)\n"
+		"  --sphere N        a sphere of N segments around\n"
+		"  --mesh FILE       a .obj or .mqo file. may be given more than once\n"
+		"  --objects K       K copies of each synthetic mesh side by side (default 1)\n"
+		"  --iterations N    calls timed for each kind (default 50)\n"
+		"  --threads N       processors reported to the plugin (default: this machine's)\n"
+		"  --sweep-threads N time the worker pool with 1 to N processors reported\n"
+		"  --viewport W H    (default 1024 768)\n"
+		"  --camera H P      head and pitch in radians (default 0.35 0.25)\n"
+		"  --setting S/N=V   a value of Metasequoia.ini, e.g. N-Move/RegionShape=1\n"
+		"  --symmetry        edit with symmetry on\n"
+		"  --dump            print picks and selections instead of timings\n"
+		"  --verbose         print messages of the plugin\n");
+	exit(1);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static double now_us()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+// samples of one kind of call, in microseconds
+class Timings
+{
+public:
+	Timings(const char* name) : m_name(name) {}
+
+	void Add(double us) { m_samples.push_back(us); }
+
+	double Mean() const
+	{
+		double sum = 0;
+		for(size_t i = 0; i < m_samples.size(); i++) sum += m_samples[i];
+		return m_samples.empty() ? 0 : sum / m_samples.size();
+	}
+
+	void Print()
+	{
+		if(m_samples.empty()) return;
+		std::sort(m_samples.begin(),m_samples.end());
+		printf("%-44s %6d %11.1f %11.1f %11.1f %11.1f\n",m_name,(int)m_samples.size(),Mean(),
+			Percentile(0.5),Percentile(0.95),m_samples.back());
+	}
+
+	static void PrintHeader()
+	{
+		printf("%-44s %6s %11s %11s %11s %11s\n","call","count","mean_us","p50_us","p95_us","max_us");
+	}
+
+	// of the sorted samples
+	double Percentile(double q)
+	{
+		std::sort(m_samples.begin(),m_samples.end());
+		size_t i = (size_t)(q * (m_samples.size() - 1) + 0.5);
+		return m_samples[i];
+	}
+
+private:
+
+	const char* m_name;
+	std::vector<double> m_samples;
+};
+
+// VmRSS for the current, VmHWM for the peak
+static long get_memory_kb(const char* key)
+{
+	FILE* fp = fopen("/proc/self/status","r");
+	if(fp == NULL) return 0;
+	char line[256];
+	long kb = 0;
+	size_t len = strlen(key);
+	while(fgets(line,sizeof(line),fp) != NULL) if(strncmp(line,key,len) == 0) kb = atol(line + len);
+	fclose(fp);
+	return kb;
+}
+
+// a fixed sequence, so that every run and every build sees the same positions
+static unsigned int s_random = 12345;
+static float next_random()
+{
+	s_random = s_random * 1664525u + 1013904223u;
+	return (s_random >> 8) / 16777216.0f;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class Bench
+{
+public:
+	Bench(const Options& options) : m_options(options)
+	{
+		m_plugin = (MQCommandPlugin*)GetPluginClass();
+	}
+
+	void Setup()
+	{
+		for(size_t i = 0; i < m_options.meshes.size(); i++)
+		{
+			if(!MQStandIn::LoadMesh(&m_doc,m_options.meshes[i].c_str())) { fprintf(stderr,"cannot read %s\n",m_options.meshes[i].c_str()); exit(1); }
+		}
+		int grid = m_options.grid;
+		if(grid == 0 && m_options.sphere == 0 && m_options.meshes.empty()) grid = 700;
+		for(int k = 0; k < m_options.objects; k++)
+		{
+			// side by side in x, so that all of them are in the view
+			if(grid > 0) add_object(MQStandIn::CreateGrid(grid,100.0f),k,0);
+			if(m_options.sphere > 0) add_object(MQStandIn::CreateSphere(m_options.sphere,50.0f),k,1);
+		}
+
+		MQPoint bmin, bmax;
+		MQStandIn::GetBounds(&m_doc,bmin,bmax);
+		MQPoint center = (bmin + bmax) * 0.5f;
+		float radius = max((bmax - bmin).abs() * 0.5f,1.0f);
+		float fov = 0.8f;
+		m_scene.SetViewport(m_options.width,m_options.height);
+		m_scene.SetCamera(center,radius / sinf(fov * 0.5f) * 1.1f,m_options.head,m_options.pitch,fov);
+
+		// where the meshes are on the screen. clicks inside hit something, the corners hit nothing
+		m_smin = MQPoint((float)m_options.width,(float)m_options.height,0);
+		m_smax = MQPoint(0,0,0);
+		for(int o = 0; o < m_doc.GetObjectCount(); o++)
+		{
+			MQObject obj = m_doc.GetObject(o);
+			int step = max(1,obj->GetVertexCount() / 4096);
+			for(int v = 0; v < obj->GetVertexCount(); v += step)
+			{
+				MQPoint sp = m_scene.Convert3DToScreen(obj->GetVertex(v));
+				m_smin.x = min(m_smin.x,sp.x); m_smin.y = min(m_smin.y,sp.y);
+				m_smax.x = max(m_smax.x,sp.x); m_smax.y = max(m_smax.y,sp.y);
+			}
+		}
+		m_smin.x = max(m_smin.x,0.0f); m_smin.y = max(m_smin.y,0.0f);
+		m_smax.x = min(m_smax.x,(float)m_options.width); m_smax.y = min(m_smax.y,(float)m_options.height);
+
+		m_plugin->Initialize();
+	}
+
+	void PrintScene()
+	{
+		long vertices = 0, faces = 0;
+		for(int o = 0; o < m_doc.GetObjectCount(); o++)
+		{
+			vertices += m_doc.GetObject(o)->GetVertexCount();
+			faces += m_doc.GetObject(o)->GetFaceCount();
+		}
+		printf("objects %d vertices %ld faces %ld threads %d\n",m_doc.GetObjectCount(),vertices,faces,m_options.threads > 0 ? m_options.threads : MQStandIn::GetHardwareProcessorCount());
+	}
+
+	void RunTimings()
+	{
+		PrintScene();
+		int n = m_options.iterations;
+		long rss_loaded = get_memory_kb("VmRSS:");
+
+		Timings activate("Activate (refresh_edge_cache)");
+		double t = now_us();
+		m_plugin->Activate(&m_doc,TRUE);
+		activate.Add(now_us() - t);
+		long rss_activated = get_memory_kb("VmRSS:");
+
+		// the first pick makes the view cache
+		Timings first_pick("first OnMouseMove (refresh_cache + pick)");
+		t = now_us();
+		hover(center_point());
+		first_pick.Add(now_us() - t);
+		long rss_cached = get_memory_kb("VmRSS:");
+
+		// nothing has changed, so all that is dropped is made again by the next pick
+		Timings modified("OnObjectModified (refresh_edge_cache)");
+		Timings after_modified("OnMouseMove after OnObjectModified");
+		for(int i = 0; i < min(n,10); i++)
+		{
+			t = now_us();
+			m_plugin->OnObjectModified(&m_doc);
+			modified.Add(now_us() - t);
+			t = now_us();
+			hover(center_point());
+			after_modified.Add(now_us() - t);
+		}
+
+		Timings view("view change + OnMouseMove (refresh_cache)");
+		MQAngle angle = m_scene.GetCameraAngle();
+		for(int i = 0; i < min(n,20); i++)
+		{
+			set_head(angle.head + 0.002f * (i + 1),angle.pitch);
+			t = now_us();
+			hover(center_point());
+			view.Add(now_us() - t);
+		}
+		set_head(angle.head,angle.pitch);
+		hover(center_point());
+
+		Timings pick("OnMouseMove + OnDraw (pick_target)");
+		for(int i = 0; i < n * 10; i++)
+		{
+			POINT p = random_point();
+			t = now_us();
+			hover(p);
+			pick.Add(now_us() - t);
+		}
+
+		Timings idle("OnDraw without changes");
+		for(int i = 0; i < n * 10; i++)
+		{
+			t = now_us();
+			m_plugin->OnDraw(&m_doc,&m_scene,m_options.width,m_options.height);
+			MQStandIn::EndDraw();
+			idle.Add(now_us() - t);
+		}
+
+		Timings selection("OnLeftButtonDown on all (get_selection)");
+		for(int i = 0; i < min(n,10); i++)
+		{
+			select_all();
+			POINT p = center_point();
+			MouseState state = mouse(p);
+			t = now_us();
+			m_plugin->OnLeftButtonDown(&m_doc,&m_scene,state);
+			selection.Add(now_us() - t);
+			m_plugin->OnLeftButtonUp(&m_doc,&m_scene,state);
+		}
+		m_doc.ClearSelect(MQDOC_CLEARSELECT_ALL);
+
+		Timings drag("OnLeftButtonMove (drag)");
+		for(int i = 0; i < min(n,10); i++)
+		{
+			POINT p = random_point();
+			MouseState state = mouse(p);
+			m_doc.ClearSelect(MQDOC_CLEARSELECT_ALL);
+			m_plugin->OnLeftButtonDown(&m_doc,&m_scene,state);
+			// out and back, so that the mesh is as it was
+			for(int k = 0; k <= 20; k++)
+			{
+				state.MousePos.x = p.x + ((k <= 10) ? k : 20 - k) * 4;
+				t = now_us();
+				m_plugin->OnLeftButtonMove(&m_doc,&m_scene,state);
+				drag.Add(now_us() - t);
+			}
+			m_plugin->OnLeftButtonUp(&m_doc,&m_scene,state);
+			m_plugin->OnObjectModified(&m_doc);
+		}
+
+		Timings region("OnLeftButtonUp of a box (regional_select)");
+		for(int i = 0; i < min(n,10); i++)
+		{
+			m_doc.ClearSelect(MQDOC_CLEARSELECT_ALL);
+			t = now_us();
+			box_select(corner_point(),box_end(0.6f));
+			region.Add(now_us() - t);
+		}
+
+		m_plugin->Activate(&m_doc,FALSE);
+
+		Timings::PrintHeader();
+		activate.Print();
+		modified.Print();
+		after_modified.Print();
+		first_pick.Print();
+		view.Print();
+		pick.Print();
+		idle.Print();
+		selection.Print();
+		drag.Print();
+		region.Print();
+		printf("rss_kb loaded %ld activated %ld view_cached %ld peak %ld\n",rss_loaded,rss_activated,rss_cached,get_memory_kb("VmHWM:"));
+		const MQStandIn::DrawingStats& stats = MQStandIn::GetDrawingStats();
+		printf("drawing objects made %ld materials made %ld\n",stats.objects,stats.materials);
+	}
+
+	// the pool is shut down between the runs, and sized again from the processors reported when it is next used.
+	// the view cache (refresh_cache), the visibility buffer and regional_select run on it
+	void RunSweep()
+	{
+		PrintScene();
+		int n = m_options.iterations;
+		printf("machine processors %d\n",MQStandIn::GetHardwareProcessorCount());
+		printf("%7s %14s %14s %14s %9s %9s  %s\n","threads","view_mean_us","region_mean_us","region_p50_us","view_x","region_x","selects");
+
+		double view1 = 0, region1 = 0;
+		for(int threads = 1; threads <= m_options.sweep_threads; threads++)
+		{
+			MQStandIn::SetProcessorCount(threads);
+			m_plugin->Exit();
+			m_plugin->Activate(&m_doc,TRUE);
+			hover(center_point());
+
+			Timings view("view");
+			MQAngle angle = m_scene.GetCameraAngle();
+			for(int i = 0; i < min(n,20); i++)
+			{
+				set_head(angle.head + 0.002f * (i + 1),angle.pitch);
+				double t = now_us();
+				hover(center_point());
+				view.Add(now_us() - t);
+			}
+			set_head(angle.head,angle.pitch);
+			hover(center_point());
+
+			Timings region("region");
+			for(int i = 0; i < min(n,10); i++)
+			{
+				m_doc.ClearSelect(MQDOC_CLEARSELECT_ALL);
+				double t = now_us();
+				box_select(corner_point(),box_end(0.6f));
+				region.Add(now_us() - t);
+			}
+			// any number of threads has to select the same
+			std::string selects = describe_selection();
+			m_doc.ClearSelect(MQDOC_CLEARSELECT_ALL);
+			m_plugin->Activate(&m_doc,FALSE);
+
+			double view_mean = view.Mean(), region_mean = region.Mean();
+			if(threads == 1) { view1 = view_mean; region1 = region_mean; }
+			printf("%7d %14.1f %14.1f %14.1f %9.2f %9.2f  %s\n",threads,view_mean,region_mean,region.Percentile(0.5),
+				view1 / view_mean,region1 / region_mean,selects.c_str());
+		}
+	}
+
+	void RunDump()
+	{
+		PrintScene();
+		m_plugin->Activate(&m_doc,TRUE);
+
+		// what is highlighted and what a click selects, over a grid of positions
+		const int G = 16;
+		for(int j = 0; j < G; j++)
+		for(int i = 0; i < G; i++)
+		{
+			POINT p;
+			p.x = (LONG)(m_smin.x + (m_smax.x - m_smin.x) * (i + 0.5f) / G);
+			p.y = (LONG)(m_smin.y + (m_smax.y - m_smin.y) * (j + 0.5f) / G);
+			m_doc.ClearSelect(MQDOC_CLEARSELECT_ALL);
+			hover(p, false);
+			int vertices, faces;
+			// how many faces draw a face highlight is up to the plugin. its vertices are what is highlighted
+			MQStandIn::GetDrawingSummary(vertices,faces);
+			MQStandIn::EndDraw();
+			MouseState state = mouse(p);
+			m_plugin->OnLeftButtonDown(&m_doc,&m_scene,state);
+			m_plugin->OnLeftButtonUp(&m_doc,&m_scene,state);
+			printf("click %ld %ld highlight %d selects %s\n",p.x,p.y,vertices,describe_selection().c_str());
+		}
+
+		// boxes of a few sizes
+		for(int k = 1; k <= 4; k++)
+		{
+			m_doc.ClearSelect(MQDOC_CLEARSELECT_ALL);
+			box_select(corner_point(),box_end(0.24f * k));
+			printf("box %d selects %s\n",k,describe_selection().c_str());
+		}
+
+		// a drag of a vertex and where everything has gone
+		m_doc.ClearSelect(MQDOC_CLEARSELECT_ALL);
+		POINT p = center_point();
+		MouseState state = mouse(p);
+		m_plugin->OnLeftButtonDown(&m_doc,&m_scene,state);
+		for(int k = 1; k <= 10; k++)
+		{
+			state.MousePos.x = p.x + k * 3;
+			m_plugin->OnLeftButtonMove(&m_doc,&m_scene,state);
+		}
+		m_plugin->OnLeftButtonUp(&m_doc,&m_scene,state);
+		printf("drag selects %s\n",describe_selection().c_str());
+		int moved = print_positions();
+		printf("drag moves %d\n",moved);
+
+		m_plugin->Activate(&m_doc,FALSE);
+	}
+
+	void Finish() { m_plugin->Exit(); }
+
+private:
+	void add_object(MQObject obj, int k, int kind)
+	{
+		MQStandIn::Translate(obj,MQPoint(k * 120.0f,kind * 120.0f,0));
+		m_doc.AddObject(obj);
+	}
+
+	void set_head(float head, float pitch)
+	{
+		MQPoint lookat = m_scene.GetLookAtPosition();
+		float distance = (m_scene.GetCameraPosition() - lookat).abs();
+		m_scene.SetCamera(lookat,distance,head,pitch,m_scene.GetFOV());
+	}
+
+	MouseState mouse(POINT p)
+	{
+		MouseState state;
+		memset(&state,0,sizeof(state));
+		state.MousePos = p;
+		return state;
+	}
+
+	POINT center_point()
+	{
+		POINT p;
+		p.x = (LONG)((m_smin.x + m_smax.x) * 0.5f);
+		p.y = (LONG)((m_smin.y + m_smax.y) * 0.5f);
+		return p;
+	}
+
+	POINT random_point()
+	{
+		POINT p;
+		p.x = (LONG)(m_smin.x + (m_smax.x - m_smin.x) * next_random());
+		p.y = (LONG)(m_smin.y + (m_smax.y - m_smin.y) * next_random());
+		return p;
+	}
+
+	POINT corner_point()
+	{
+		POINT p;
+		p.x = 2;
+		p.y = 2;
+		return p;
+	}
+
+	POINT box_end(float f)
+	{
+		POINT p;
+		p.x = (LONG)(m_options.width * f);
+		p.y = (LONG)(m_options.height * f);
+		return p;
+	}
+
+	// a mouse move and the redraw it asks for
+	void hover(POINT p, bool end_draw = true)
+	{
+		MouseState state = mouse(p);
+		m_plugin->OnMouseMove(&m_doc,&m_scene,state);
+		m_plugin->OnDraw(&m_doc,&m_scene,m_options.width,m_options.height);
+		if(end_draw) MQStandIn::EndDraw();
+	}
+
+	void box_select(POINT from, POINT to)
+	{
+		MouseState state = mouse(from);
+		m_plugin->OnLeftButtonDown(&m_doc,&m_scene,state);
+		state.MousePos = to;
+		m_plugin->OnLeftButtonMove(&m_doc,&m_scene,state);
+		MQStandIn::EndDraw();
+		m_plugin->OnLeftButtonUp(&m_doc,&m_scene,state);
+	}
+
+	void select_all()
+	{
+		for(int o = 0; o < m_doc.GetObjectCount(); o++)
+		{
+			MQObject obj = m_doc.GetObject(o);
+			for(int v = 0; v < obj->GetVertexCount(); v++) m_doc.AddSelectVertex(o,v);
+		}
+	}
+
+	static unsigned int hash_add(unsigned int h, unsigned int x)
+	{
+		return (h ^ x) * 16777619u;
+	}
+
+	// counts, and a hash of what is selected
+	std::string describe_selection()
+	{
+		unsigned int h = 2166136261u;
+		const std::set<std::pair<int,int> >& vertices = m_doc.GetSelectedVertices();
+		for(std::set<std::pair<int,int> >::const_iterator it = vertices.begin(); it != vertices.end(); ++it) h = hash_add(hash_add(h,it->first),it->second);
+		const std::set<std::pair<int,std::pair<int,int> > >& lines = m_doc.GetSelectedLines();
+		for(std::set<std::pair<int,std::pair<int,int> > >::const_iterator it = lines.begin(); it != lines.end(); ++it) h = hash_add(hash_add(hash_add(h,it->first),it->second.first),it->second.second);
+		const std::set<std::pair<int,int> >& faces = m_doc.GetSelectedFaces();
+		for(std::set<std::pair<int,int> >::const_iterator it = faces.begin(); it != faces.end(); ++it) h = hash_add(hash_add(h,it->first),it->second);
+
+		char buf[128];
+		sprintf(buf,"v %d l %d f %d #%08x",(int)vertices.size(),(int)lines.size(),(int)faces.size(),h);
+		return buf;
+	}
+
+	// where every vertex is, and how many are off where they were made
+	int print_positions()
+	{
+		int moved = 0;
+		for(int o = 0; o < m_doc.GetObjectCount(); o++)
+		{
+			MQObject obj = m_doc.GetObject(o);
+			for(int v = 0; v < obj->GetVertexCount(); v++)
+			{
+				MQPoint p = obj->GetVertex(v);
+				if(floorf(p.z * 1000.0f + 0.5f) != 0) moved++;
+				printf("vertex %d %d %.4f %.4f %.4f\n",o,v,p.x,p.y,p.z);
+			}
+		}
+		return moved;
+	}
+
+	Options m_options;
+	MQCommandPlugin* m_plugin;
+	MQCDocument m_doc;
+	MQCScene m_scene;
+	MQPoint m_smin, m_smax;
+};
+
+int main(int argc, char** argv)
+{
+	Options options;
+	options.grid = 0;
+	options.sphere = 0;
+	options.objects = 1;
+	options.iterations = 50;
+	options.threads = 0;
+	options.sweep_threads = 0;
+	options.width = 1024;
+	options.height = 768;
+	options.head = 0.35f;
+	options.pitch = 0.25f;
+	options.dump = false;
+	options.verbose = false;
+
+	for(int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool more = (i + 1 < argc);
+		if(arg == "--grid" && more) options.grid = atoi(argv[++i]);
+		else if(arg == "--sphere" && more) options.sphere = atoi(argv[++i]);
+		else if(arg == "--mesh" && more) options.meshes.push_back(argv[++i]);
+		else if(arg == "--objects" && more) options.objects = max(1,atoi(argv[++i]));
+		else if(arg == "--iterations" && more) options.iterations = max(1,atoi(argv[++i]));
+		else if(arg == "--threads" && more) options.threads = atoi(argv[++i]);
+		else if(arg == "--sweep-threads" && more) options.sweep_threads = min(32,atoi(argv[++i]));
+		else if(arg == "--viewport" && i + 2 < argc) { options.width = atoi(argv[++i]); options.height = atoi(argv[++i]); }
+		else if(arg == "--camera" && i + 2 < argc) { options.head = (float)atof(argv[++i]); options.pitch = (float)atof(argv[++i]); }
+		else if(arg == "--setting" && more)
+		{
+			std::string s = argv[++i];
+			size_t slash = s.find('/'), eq = s.find('=');
+			if(slash == std::string::npos || eq == std::string::npos || eq < slash) usage();
+			MQStandIn::SetSetting(s.substr(0,slash).c_str(),s.substr(slash + 1,eq - slash - 1).c_str(),s.substr(eq + 1).c_str());
+		}
+		else if(arg == "--symmetry") MQStandIn::GetEditOption().Symmetry = true;
+		else if(arg == "--dump") options.dump = true;
+		else if(arg == "--verbose") options.verbose = true;
+		else usage();
+	}
+
+	MQStandIn::SetProcessorCount(options.threads);
+	MQStandIn::SetVerbose(options.verbose);
+
+	Bench bench(options);
+	bench.Setup();
+	if(options.dump) bench.RunDump();
+	else if(options.sweep_threads > 0) bench.RunSweep();
+	else bench.RunTimings();
+	bench.Finish();
+	return 0;
+}
@@ -0,0 +1,41 @@
+# compares two --dump outputs line by line: awk -f compare.awk old new
+# the coordinates on "vertex" lines may differ by rounding, as two builds need not add up a drag
+# in the same order. everything else must be the same
+BEGIN { tolerance = 0.001 }
+
+FNR == NR { old[FNR] = $0; old_lines = FNR; next }
+
+{
+	new_lines = FNR
+	if(!same(old[FNR], $0))
+	{
+		print FNR ":"
+		print "< " old[FNR]
+		print "> " $0
+		differs++
+	}
+}
+
+END {
+	if(old_lines != new_lines)
+	{
+		print "the dumps have " old_lines " and " new_lines " lines"
+		differs++
+	}
+	exit differs ? 1 : 0
+}
+
+function same(a, b,   x, y, n, i, d)
+{
+	if(a == b) return 1
+	if(a !~ /^vertex / || b !~ /^vertex /) return 0
+	n = split(a, x)
+	if(split(b, y) != n) return 0
+	for(i = 1; i <= n; i++)
+	{
+		if(i <= 3) { if(x[i] != y[i]) return 0; continue }
+		d = x[i] - y[i]
+		if(d > tolerance || -d > tolerance) return 0
+	}
+	return 1
+}
@@ -0,0 +1,11 @@
+// Stand-in for the geometry helpers of the Metasequoia SDK
+#pragma once
+
+MQPoint GetNormal(const MQPoint& p0, const MQPoint& p1, const MQPoint& p2);
+MQPoint GetQuadNormal(const MQPoint& p0, const MQPoint& p1, const MQPoint& p2, const MQPoint& p3);
+MQPoint GetPolyNormal(const MQPoint* points, int count);
+float GetInnerProduct(const MQPoint& a, const MQPoint& b);
+MQPoint GetCrossProduct(const MQPoint& a, const MQPoint& b);
+
+// clockwise on the screen is the front, as in Metasequoia
+BOOL IsFrontFace(MQScene scene, MQObject obj, int face);
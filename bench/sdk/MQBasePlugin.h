@@ -0,0 +1,278 @@
+// Stand-in for the Metasequoia SDK classes ExMove.cpp uses. Documents, objects and scenes live in memory,
+// so that the plugin can be built and driven on Linux by the benchmark. Only what the plugin calls is here.
+// signatures follow the SDK, bodies are in MQStandIn.cpp
+#pragma once
+
+#include <math.h>
+#include <vector>
+#include <set>
+#include <string>
+
+class MQPoint
+{
+public:
+	float x, y, z;
+
+	MQPoint() {}
+	MQPoint(float nx, float ny, float nz) : x(nx), y(ny), z(nz) {}
+
+	MQPoint operator+(const MQPoint& p) const { return MQPoint(x + p.x, y + p.y, z + p.z); }
+	MQPoint operator-(const MQPoint& p) const { return MQPoint(x - p.x, y - p.y, z - p.z); }
+	MQPoint operator-() const { return MQPoint(-x, -y, -z); }
+	MQPoint operator*(float f) const { return MQPoint(x * f, y * f, z * f); }
+	MQPoint operator/(float f) const { return MQPoint(x / f, y / f, z / f); }
+	MQPoint& operator+=(const MQPoint& p) { x += p.x; y += p.y; z += p.z; return *this; }
+	MQPoint& operator-=(const MQPoint& p) { x -= p.x; y -= p.y; z -= p.z; return *this; }
+	MQPoint& operator*=(float f) { x *= f; y *= f; z *= f; return *this; }
+	MQPoint& operator/=(float f) { x /= f; y /= f; z /= f; return *this; }
+	bool operator==(const MQPoint& p) const { return x == p.x && y == p.y && z == p.z; }
+	bool operator!=(const MQPoint& p) const { return !(*this == p); }
+
+	float norm() const { return x * x + y * y + z * z; }
+	float abs() const { return sqrtf(norm()); }
+	void normalize() { float a = abs(); if(a > 0) { x /= a; y /= a; z /= a; } }
+	void zero() { x = y = z = 0; }
+};
+
+class MQAngle
+{
+public:
+	float head, pitch, bank;
+
+	MQAngle() {}
+	MQAngle(float h, float p, float b) : head(h), pitch(p), bank(b) {}
+};
+
+class MQColor
+{
+public:
+	float r, g, b;
+
+	MQColor() {}
+	MQColor(float nr, float ng, float nb) : r(nr), g(ng), b(nb) {}
+};
+
+struct MQSelectVertex
+{
+	int object;
+	int vertex;
+
+	MQSelectVertex() {}
+	MQSelectVertex(int o, int v) : object(o), vertex(v) {}
+};
+
+#define MQMATERIAL_SHADER_CLASSIC 0
+
+class MQCMaterial
+{
+public:
+	void SetColor(const MQColor& color) { m_color = color; }
+	void SetAlpha(float) {}
+	void SetAmbient(float) {}
+	void SetDiffuse(float) {}
+	void SetEmission(float) {}
+	void SetPower(float) {}
+	void SetSpecular(float) {}
+	void SetShader(int) {}
+
+private:
+	MQColor m_color;
+};
+typedef MQCMaterial* MQMaterial;
+
+class MQCObject
+{
+public:
+	MQCObject();
+
+	int GetVertexCount();
+	MQPoint GetVertex(int index);
+	void SetVertex(int index, const MQPoint& p);
+	int GetVertexRefCount(int index);
+	int AddVertex(const MQPoint& p);
+
+	int GetFaceCount();
+	int GetFacePointCount(int face);
+	void GetFacePointArray(int face, int* vertices);
+	int AddFace(int count, int* vertices);
+	// the face is left empty, as the SDK does until the object is compacted
+	BOOL DeleteFace(int face, bool delete_vertex = true);
+	int GetFaceMaterial(int face);
+	void SetFaceMaterial(int face, int material);
+
+	BOOL GetVisible() { return m_visible; }
+	BOOL GetLocking() { return m_locking; }
+	void SetColor(const MQColor& color) { m_color = color; }
+	void SetColorValid(BOOL flag) { m_color_valid = flag; }
+
+	int GetUniqueID() { return m_unique_id; }
+	void DeleteThis() { delete this; }
+
+	// stand-in only
+	void SetVisible(BOOL flag) { m_visible = flag; }
+	void SetLocking(BOOL flag) { m_locking = flag; }
+	void Reserve(int vertices, int faces, int corners);
+
+private:
+	std::vector<MQPoint> m_vertices;
+	std::vector<int> m_refcounts;
+	std::vector<int> m_face_offsets;	// first corner of each face
+	std::vector<int> m_face_counts;
+	std::vector<int> m_corners;
+	std::vector<int> m_materials;
+	BOOL m_visible, m_locking;
+	MQColor m_color;
+	BOOL m_color_valid;
+	int m_unique_id;
+};
+typedef MQCObject* MQObject;
+
+#define MQDOC_CLEARSELECT_VERTEX	1
+#define MQDOC_CLEARSELECT_LINE		2
+#define MQDOC_CLEARSELECT_FACE		4
+#define MQDOC_CLEARSELECT_ALL		7
+
+class MQCDocument
+{
+public:
+	int GetObjectCount() { return (int)m_objects.size(); }
+	MQObject GetObject(int index) { return (index >= 0 && index < (int)m_objects.size()) ? m_objects[index] : NULL; }
+	int GetObjectIndex(MQObject obj);
+	int GetCurrentObjectIndex() { return m_current; }
+
+	BOOL IsSelectVertex(int o, int v);
+	BOOL IsSelectLine(int o, int f, int l);
+	BOOL IsSelectFace(int o, int f);
+	BOOL AddSelectVertex(int o, int v);
+	BOOL AddSelectLine(int o, int f, int l);
+	BOOL AddSelectFace(int o, int f);
+	BOOL DeleteSelectVertex(int o, int v);
+	BOOL DeleteSelectLine(int o, int f, int l);
+	BOOL DeleteSelectFace(int o, int f);
+	void ClearSelect(DWORD flag);
+
+	// stand-in only
+	int AddObject(MQObject obj);
+	void SetCurrentObjectIndex(int index) { m_current = index; }
+	void DeleteAllObjects();
+	const std::set<std::pair<int,int> >& GetSelectedVertices() const { return m_vertices; }
+	const std::set<std::pair<int,std::pair<int,int> > >& GetSelectedLines() const { return m_lines; }
+	const std::set<std::pair<int,int> >& GetSelectedFaces() const { return m_faces; }
+
+	MQCDocument() { m_current = 0; }
+
+private:
+	std::vector<MQObject> m_objects;
+	int m_current;
+	std::set<std::pair<int,int> > m_vertices;
+	std::set<std::pair<int,std::pair<int,int> > > m_lines;
+	std::set<std::pair<int,int> > m_faces;
+};
+typedef MQCDocument* MQDocument;
+
+// a perspective camera. screen y goes down and z is the depth in [0,1] from the near to the far plane
+class MQCScene
+{
+public:
+	MQCScene();
+
+	MQPoint Convert3DToScreen(const MQPoint& p, float* w = NULL);
+	MQPoint ConvertScreenTo3D(const MQPoint& p);
+
+	MQPoint GetCameraPosition() { return m_position; }
+	MQAngle GetCameraAngle() { return m_angle; }
+	MQPoint GetCameraDirection() { return m_forward; }
+	MQPoint GetLookAtPosition() { return m_lookat; }
+	MQPoint GetRotationCenter() { return m_lookat; }
+	float GetFOV() { return m_fov; }
+	BOOL GetVisibleFace(MQObject obj, BOOL* visible);
+
+	// stand-in only. angles in radians, fov is vertical
+	void SetCamera(const MQPoint& lookat, float distance, float head, float pitch, float fov);
+	void SetViewport(int width, int height) { m_width = width; m_height = height; update(); }
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+
+private:
+	void update();
+
+	MQPoint m_lookat, m_position;
+	MQAngle m_angle;
+	float m_distance, m_fov;
+	int m_width, m_height;
+	float m_near, m_far, m_focal;
+	MQPoint m_right, m_up, m_forward;
+};
+typedef MQCScene* MQScene;
+
+class MQBasePlugin
+{
+public:
+	virtual ~MQBasePlugin() {}
+	virtual void GetPlugInID(DWORD* Product, DWORD* ID) = 0;
+	virtual const char* GetPlugInName(void) = 0;
+	virtual const char* EnumString(void) = 0;
+	virtual BOOL Initialize() { return TRUE; }
+	virtual void Exit() {}
+
+	BOOL SendUserMessage(MQDocument doc, DWORD product, DWORD id, const char* description, void* message);
+};
+
+class MQCommandPlugin : public MQBasePlugin
+{
+public:
+	struct EDIT_OPTION
+	{
+		bool EditVertex, EditLine, EditFace;
+		bool SelectRect, SelectRope;
+		bool SnapX, SnapY, SnapZ;
+		bool CoordinateWorld, CoordinateScreen, CoordinateLocal;
+		bool SnapGrid;
+		bool Symmetry;
+		float SymmetryDistance;
+		bool CurrentObjectOnly;
+	};
+
+	struct MOUSE_BUTTON_STATE
+	{
+		POINT MousePos;
+		int Wheel;
+		bool LButton, MButton, RButton;
+		bool Shift, Ctrl, Alt;
+	};
+
+	enum DRAW_OBJECT_VISIBILITY
+	{
+		DRAW_OBJECT_POINT = 1,
+		DRAW_OBJECT_LINE = 2,
+		DRAW_OBJECT_FACE = 4,
+	};
+
+	virtual BOOL Activate(MQDocument doc, BOOL flag) { return flag; }
+	virtual void OnDraw(MQDocument doc, MQScene scene, int width, int height) {}
+	virtual BOOL OnLeftButtonDown(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state) { return FALSE; }
+	virtual BOOL OnLeftButtonMove(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state) { return FALSE; }
+	virtual BOOL OnLeftButtonUp(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state) { return FALSE; }
+	virtual BOOL OnRightButtonDown(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state) { return FALSE; }
+	virtual BOOL OnRightButtonMove(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state) { return FALSE; }
+	virtual BOOL OnRightButtonUp(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state) { return FALSE; }
+	virtual BOOL OnMouseMove(MQDocument doc, MQScene scene, MOUSE_BUTTON_STATE& state) { return FALSE; }
+	virtual void OnObjectModified(MQDocument doc) {}
+	virtual void OnUpdateObjectList(MQDocument doc) {}
+	virtual void OnUpdateUndo(MQDocument doc, int undo_state, int redo_size) {}
+
+	void GetEditOption(EDIT_OPTION& option);
+	void RedrawScene(MQScene scene);
+	void RedrawAllScene();
+	void UpdateUndo();
+
+	MQObject CreateDrawingObject(MQDocument doc, DRAW_OBJECT_VISIBILITY visibility, BOOL instant = TRUE);
+	MQMaterial CreateDrawingMaterial(MQDocument doc, int& index, BOOL instant = TRUE);
+	void DeleteDrawingObject(MQDocument doc, MQObject obj);
+	void DeleteDrawingMaterial(MQDocument doc, MQMaterial mat);
+};
+
+enum { MQFOLDER_METASEQ_INI };
+BOOL MQ_GetSystemPath(char* buffer, int type);
+
+MQBasePlugin* GetPluginClass();
@@ -0,0 +1,16 @@
+// Stand-in for the settings of the Metasequoia SDK. values are given by the benchmark through MQStandIn::SetSetting
+#pragma once
+
+#include <string>
+
+class MQSetting
+{
+public:
+	MQSetting(const char* path, const char* section);
+
+	void Load(const char* name, unsigned int& value, unsigned int default_value);
+	void Load(const char* name, float& value, float default_value);
+
+private:
+	std::string m_section;
+};
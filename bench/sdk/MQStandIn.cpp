@@ -0,0 +1,737 @@
+// In-memory stand-in for the Metasequoia SDK and the Win32 calls ExMove.cpp makes
+#include <windows.h>
+#include "MQBasePlugin.h"
+#include "MQ3DLib.h"
+#include "MQSetting.h"
+#include "MQStandIn.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <algorithm>
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Win32
+
+void InitializeCriticalSection(CRITICAL_SECTION* cs) { pthread_mutex_init(&cs->mutex,NULL); }
+void DeleteCriticalSection(CRITICAL_SECTION* cs) { pthread_mutex_destroy(&cs->mutex); }
+void EnterCriticalSection(CRITICAL_SECTION* cs) { pthread_mutex_lock(&cs->mutex); }
+void LeaveCriticalSection(CRITICAL_SECTION* cs) { pthread_mutex_unlock(&cs->mutex); }
+
+// a thread or an event behind a HANDLE
+struct StandInHandle
+{
+	bool thread;
+	pthread_t id;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool manual_reset;
+	bool signaled;
+};
+
+struct ThreadStart
+{
+	LPTHREAD_START_ROUTINE start;
+	LPVOID param;
+};
+
+static void* thread_main(void* p)
+{
+	ThreadStart* ts = (ThreadStart*)p;
+	ts->start(ts->param);
+	delete ts;
+	return NULL;
+}
+
+HANDLE CreateThread(void*, size_t, LPTHREAD_START_ROUTINE start, LPVOID param, DWORD, DWORD*)
+{
+	StandInHandle* h = new StandInHandle;
+	h->thread = true;
+	ThreadStart* ts = new ThreadStart;
+	ts->start = start;
+	ts->param = param;
+	if(pthread_create(&h->id,NULL,thread_main,ts) != 0) { delete ts; delete h; return NULL; }
+	return h;
+}
+
+HANDLE CreateEvent(void*, BOOL manual_reset, BOOL initial_state, const char*)
+{
+	StandInHandle* h = new StandInHandle;
+	h->thread = false;
+	pthread_mutex_init(&h->mutex,NULL);
+	pthread_cond_init(&h->cond,NULL);
+	h->manual_reset = (manual_reset != FALSE);
+	h->signaled = (initial_state != FALSE);
+	return h;
+}
+
+BOOL SetEvent(HANDLE event)
+{
+	StandInHandle* h = (StandInHandle*)event;
+	pthread_mutex_lock(&h->mutex);
+	h->signaled = true;
+	pthread_cond_broadcast(&h->cond);
+	pthread_mutex_unlock(&h->mutex);
+	return TRUE;
+}
+
+BOOL ResetEvent(HANDLE event)
+{
+	StandInHandle* h = (StandInHandle*)event;
+	pthread_mutex_lock(&h->mutex);
+	h->signaled = false;
+	pthread_mutex_unlock(&h->mutex);
+	return TRUE;
+}
+
+// timeouts are not supported. everything is waited for until it comes
+DWORD WaitForSingleObject(HANDLE handle, DWORD)
+{
+	StandInHandle* h = (StandInHandle*)handle;
+	if(h->thread) { pthread_join(h->id,NULL); return 0; }
+	pthread_mutex_lock(&h->mutex);
+	while(!h->signaled) pthread_cond_wait(&h->cond,&h->mutex);
+	if(!h->manual_reset) h->signaled = false;
+	pthread_mutex_unlock(&h->mutex);
+	return 0;
+}
+
+DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL, DWORD ms)
+{
+	for(DWORD i = 0; i < count; i++) WaitForSingleObject(handles[i],ms);
+	return 0;
+}
+
+BOOL CloseHandle(HANDLE handle)
+{
+	StandInHandle* h = (StandInHandle*)handle;
+	if(!h->thread)
+	{
+		pthread_mutex_destroy(&h->mutex);
+		pthread_cond_destroy(&h->cond);
+	}
+	delete h;
+	return TRUE;
+}
+
+LONG InterlockedIncrement(volatile LONG* p) { return __sync_add_and_fetch(p,1); }
+LONG InterlockedDecrement(volatile LONG* p) { return __sync_sub_and_fetch(p,1); }
+LONG InterlockedExchange(volatile LONG* p, LONG value) { return __sync_lock_test_and_set(p,value); }
+LONG InterlockedExchangeAdd(volatile LONG* p, LONG value) { return __sync_fetch_and_add(p,value); }
+LONG InterlockedCompareExchange(volatile LONG* p, LONG exchange, LONG comparand) { return __sync_val_compare_and_swap(p,comparand,exchange); }
+
+static int s_processors = 0;
+
+void GetSystemInfo(SYSTEM_INFO* info)
+{
+	info->dwNumberOfProcessors = (s_processors > 0) ? s_processors : MQStandIn::GetHardwareProcessorCount();
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count)
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	count->QuadPart = (LONGLONG)t.tv_sec * 1000000000LL + t.tv_nsec;
+	return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* freq)
+{
+	freq->QuadPart = 1000000000LL;
+	return TRUE;
+}
+
+DWORD GetTickCount()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return (DWORD)(t.tv_sec * 1000 + t.tv_nsec / 1000000);
+}
+
+void Sleep(DWORD ms) { usleep(ms * 1000); }
+
+DWORD GetEnvironmentVariableA(const char* name, char* buffer, DWORD size)
+{
+	const char* value = getenv(name);
+	if(value == NULL) return 0;
+	DWORD len = (DWORD)strlen(value);
+	if(len >= size) return len + 1;
+	memcpy(buffer,value,len + 1);
+	return len;
+}
+
+int fopen_s(FILE** fp, const char* path, const char* mode)
+{
+	*fp = fopen(path,mode);
+	return (*fp != NULL) ? 0 : 1;
+}
+
+int vsnprintf_s(char* buffer, size_t size, size_t, const char* format, va_list args)
+{
+	return vsnprintf(buffer,size,format,args);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MQCObject
+
+static int s_next_unique_id = 1;
+
+MQCObject::MQCObject()
+{
+	m_visible = TRUE;
+	m_locking = FALSE;
+	m_color = MQColor(1,1,1);
+	m_color_valid = FALSE;
+	m_unique_id = s_next_unique_id++;
+	m_face_offsets.push_back(0);
+}
+
+void MQCObject::Reserve(int vertices, int faces, int corners)
+{
+	m_vertices.reserve(vertices);
+	m_refcounts.reserve(vertices);
+	m_face_offsets.reserve(faces + 1);
+	m_face_counts.reserve(faces);
+	m_materials.reserve(faces);
+	m_corners.reserve(corners);
+}
+
+int MQCObject::GetVertexCount() { return (int)m_vertices.size(); }
+MQPoint MQCObject::GetVertex(int index) { return m_vertices[index]; }
+void MQCObject::SetVertex(int index, const MQPoint& p) { m_vertices[index] = p; }
+int MQCObject::GetVertexRefCount(int index) { return m_refcounts[index]; }
+
+int MQCObject::AddVertex(const MQPoint& p)
+{
+	m_vertices.push_back(p);
+	m_refcounts.push_back(0);
+	return (int)m_vertices.size() - 1;
+}
+
+int MQCObject::GetFaceCount() { return (int)m_face_counts.size(); }
+int MQCObject::GetFacePointCount(int face) { return m_face_counts[face]; }
+
+void MQCObject::GetFacePointArray(int face, int* vertices)
+{
+	const int* corners = &m_corners[m_face_offsets[face]];
+	for(int i = 0; i < m_face_counts[face]; i++) vertices[i] = corners[i];
+}
+
+int MQCObject::AddFace(int count, int* vertices)
+{
+	for(int i = 0; i < count; i++)
+	{
+		m_corners.push_back(vertices[i]);
+		m_refcounts[vertices[i]]++;
+	}
+	m_face_counts.push_back(count);
+	m_face_offsets.push_back((int)m_corners.size());
+	m_materials.push_back(0);
+	return (int)m_face_counts.size() - 1;
+}
+
+BOOL MQCObject::DeleteFace(int face, bool)
+{
+	if(face < 0 || face >= GetFaceCount()) return FALSE;
+	const int* corners = &m_corners[m_face_offsets[face]];
+	for(int i = 0; i < m_face_counts[face]; i++) m_refcounts[corners[i]]--;
+	m_face_counts[face] = 0;
+	return TRUE;
+}
+
+int MQCObject::GetFaceMaterial(int face) { return m_materials[face]; }
+void MQCObject::SetFaceMaterial(int face, int material) { m_materials[face] = material; }
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MQCDocument
+
+int MQCDocument::AddObject(MQObject obj)
+{
+	m_objects.push_back(obj);
+	return (int)m_objects.size() - 1;
+}
+
+void MQCDocument::DeleteAllObjects()
+{
+	for(size_t i = 0; i < m_objects.size(); i++) m_objects[i]->DeleteThis();
+	m_objects.clear();
+	ClearSelect(MQDOC_CLEARSELECT_ALL);
+}
+
+int MQCDocument::GetObjectIndex(MQObject obj)
+{
+	for(size_t i = 0; i < m_objects.size(); i++) if(m_objects[i] == obj) return (int)i;
+	return -1;
+}
+
+BOOL MQCDocument::IsSelectVertex(int o, int v) { return m_vertices.count(std::make_pair(o,v)) != 0; }
+BOOL MQCDocument::IsSelectLine(int o, int f, int l) { return m_lines.count(std::make_pair(o,std::make_pair(f,l))) != 0; }
+BOOL MQCDocument::IsSelectFace(int o, int f) { return m_faces.count(std::make_pair(o,f)) != 0; }
+BOOL MQCDocument::AddSelectVertex(int o, int v) { m_vertices.insert(std::make_pair(o,v)); return TRUE; }
+BOOL MQCDocument::AddSelectLine(int o, int f, int l) { m_lines.insert(std::make_pair(o,std::make_pair(f,l))); return TRUE; }
+BOOL MQCDocument::AddSelectFace(int o, int f) { m_faces.insert(std::make_pair(o,f)); return TRUE; }
+BOOL MQCDocument::DeleteSelectVertex(int o, int v) { m_vertices.erase(std::make_pair(o,v)); return TRUE; }
+BOOL MQCDocument::DeleteSelectLine(int o, int f, int l) { m_lines.erase(std::make_pair(o,std::make_pair(f,l))); return TRUE; }
+BOOL MQCDocument::DeleteSelectFace(int o, int f) { m_faces.erase(std::make_pair(o,f)); return TRUE; }
+
+void MQCDocument::ClearSelect(DWORD flag)
+{
+	if(flag & MQDOC_CLEARSELECT_VERTEX) m_vertices.clear();
+	if(flag & MQDOC_CLEARSELECT_LINE) m_lines.clear();
+	if(flag & MQDOC_CLEARSELECT_FACE) m_faces.clear();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MQCScene
+
+static MQPoint cross(const MQPoint& a, const MQPoint& b)
+{
+	return MQPoint(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+static float dot(const MQPoint& a, const MQPoint& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+MQCScene::MQCScene()
+{
+	m_width = 800;
+	m_height = 600;
+	SetCamera(MQPoint(0,0,0),100.0f,0,0,0.8f);
+}
+
+void MQCScene::SetCamera(const MQPoint& lookat, float distance, float head, float pitch, float fov)
+{
+	m_lookat = lookat;
+	m_distance = distance;
+	m_angle = MQAngle(head,pitch,0);
+	m_fov = fov;
+	update();
+}
+
+void MQCScene::update()
+{
+	// the camera is behind the look-at position along -forward
+	MQPoint back(sinf(m_angle.head) * cosf(m_angle.pitch), sinf(m_angle.pitch), cosf(m_angle.head) * cosf(m_angle.pitch));
+	m_position = m_lookat + back * m_distance;
+	m_forward = -back;
+	m_right = cross(m_forward,MQPoint(0,1,0));
+	m_right.normalize();
+	m_up = cross(m_right,m_forward);
+
+	m_near = m_distance * 0.01f;
+	m_far = m_distance * 100.0f;
+	m_focal = (float)m_height * 0.5f / tanf(m_fov * 0.5f);
+}
+
+MQPoint MQCScene::Convert3DToScreen(const MQPoint& p, float* w)
+{
+	MQPoint d = p - m_position;
+	float vx = dot(d,m_right), vy = dot(d,m_up), vz = dot(d,m_forward);
+	if(w != NULL) *w = vz;
+	return MQPoint(m_width * 0.5f + vx * m_focal / vz, m_height * 0.5f - vy * m_focal / vz, (m_far / (m_far - m_near)) * (1.0f - m_near / vz));
+}
+
+MQPoint MQCScene::ConvertScreenTo3D(const MQPoint& p)
+{
+	float vz = m_near / (1.0f - p.z * (m_far - m_near) / m_far);
+	float vx = (p.x - m_width * 0.5f) * vz / m_focal;
+	float vy = -(p.y - m_height * 0.5f) * vz / m_focal;
+	return m_position + m_right * vx + m_up * vy + m_forward * vz;
+}
+
+BOOL MQCScene::GetVisibleFace(MQObject obj, BOOL* visible)
+{
+	for(int f = 0; f < obj->GetFaceCount(); f++) visible[f] = TRUE;
+	return TRUE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// geometry helpers
+
+MQPoint GetNormal(const MQPoint& p0, const MQPoint& p1, const MQPoint& p2)
+{
+	MQPoint n = cross(p1 - p0,p2 - p0);
+	n.normalize();
+	return n;
+}
+
+MQPoint GetQuadNormal(const MQPoint& p0, const MQPoint& p1, const MQPoint& p2, const MQPoint& p3)
+{
+	MQPoint n = cross(p2 - p0,p3 - p1);
+	n.normalize();
+	return n;
+}
+
+// Newell's method
+MQPoint GetPolyNormal(const MQPoint* points, int count)
+{
+	MQPoint n(0,0,0);
+	for(int i = 0; i < count; i++)
+	{
+		const MQPoint& a = points[i];
+		const MQPoint& b = points[(i + 1) % count];
+		n.x += (a.y - b.y) * (a.z + b.z);
+		n.y += (a.z - b.z) * (a.x + b.x);
+		n.z += (a.x - b.x) * (a.y + b.y);
+	}
+	n.normalize();
+	return n;
+}
+
+float GetInnerProduct(const MQPoint& a, const MQPoint& b) { return dot(a,b); }
+MQPoint GetCrossProduct(const MQPoint& a, const MQPoint& b) { return cross(a,b); }
+
+BOOL IsFrontFace(MQScene scene, MQObject obj, int face)
+{
+	int count = obj->GetFacePointCount(face);
+	if(count < 3) return FALSE;
+	std::vector<int> corners(count);
+	obj->GetFacePointArray(face,&corners[0]);
+	MQPoint a = scene->Convert3DToScreen(obj->GetVertex(corners[0]));
+	MQPoint b = scene->Convert3DToScreen(obj->GetVertex(corners[1]));
+	MQPoint c = scene->Convert3DToScreen(obj->GetVertex(corners[2]));
+	return ((b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x)) > 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// plugin services
+
+static MQCommandPlugin::EDIT_OPTION s_edit_option = {
+	true, true, true,		// EditVertex, EditLine, EditFace
+	true, false,			// SelectRect, SelectRope
+	false, false, false,	// SnapX, SnapY, SnapZ
+	true, false, false,		// CoordinateWorld, CoordinateScreen, CoordinateLocal
+	false,					// SnapGrid
+	false, 0.0f,			// Symmetry, SymmetryDistance
+	false					// CurrentObjectOnly
+};
+
+static bool s_verbose = false;
+static std::map<std::string,std::string> s_settings;
+
+static MQStandIn::DrawingStats s_drawing_stats = { 0, 0, 0 };
+static std::vector<MQObject> s_instant_objects;
+static std::vector<MQObject> s_drawing_objects;
+static std::vector<MQMaterial> s_instant_materials;
+static int s_next_material = 1;
+
+BOOL MQBasePlugin::SendUserMessage(MQDocument, DWORD, DWORD, const char* description, void* message)
+{
+	if(s_verbose) fprintf(stderr,"%s: %s\n",description,(const char*)message);
+	return TRUE;
+}
+
+void MQCommandPlugin::GetEditOption(EDIT_OPTION& option) { option = s_edit_option; }
+void MQCommandPlugin::RedrawScene(MQScene) {}
+void MQCommandPlugin::RedrawAllScene() {}
+void MQCommandPlugin::UpdateUndo() {}
+
+MQObject MQCommandPlugin::CreateDrawingObject(MQDocument, DRAW_OBJECT_VISIBILITY, BOOL instant)
+{
+	MQObject obj = new MQCObject;
+	s_drawing_stats.objects++;
+	if(instant) { s_instant_objects.push_back(obj); s_drawing_stats.instant_alive++; }
+	else s_drawing_objects.push_back(obj);
+	return obj;
+}
+
+MQMaterial MQCommandPlugin::CreateDrawingMaterial(MQDocument, int& index, BOOL instant)
+{
+	MQMaterial mat = new MQCMaterial;
+	s_drawing_stats.materials++;
+	if(instant) s_instant_materials.push_back(mat);
+	index = s_next_material++;
+	return mat;
+}
+
+void MQCommandPlugin::DeleteDrawingObject(MQDocument, MQObject obj)
+{
+	std::vector<MQObject>::iterator it = std::find(s_drawing_objects.begin(),s_drawing_objects.end(),obj);
+	if(it == s_drawing_objects.end()) return;
+	s_drawing_objects.erase(it);
+	delete obj;
+}
+
+void MQCommandPlugin::DeleteDrawingMaterial(MQDocument, MQMaterial mat)
+{
+	delete mat;
+}
+
+BOOL MQ_GetSystemPath(char* buffer, int)
+{
+	strcpy(buffer,"Metasequoia.ini");
+	return TRUE;
+}
+
+MQSetting::MQSetting(const char*, const char* section) : m_section(section) {}
+
+void MQSetting::Load(const char* name, unsigned int& value, unsigned int default_value)
+{
+	std::map<std::string,std::string>::const_iterator it = s_settings.find(m_section + "/" + name);
+	value = (it != s_settings.end()) ? (unsigned int)strtoul(it->second.c_str(),NULL,0) : default_value;
+}
+
+void MQSetting::Load(const char* name, float& value, float default_value)
+{
+	std::map<std::string,std::string>::const_iterator it = s_settings.find(m_section + "/" + name);
+	value = (it != s_settings.end()) ? (float)atof(it->second.c_str()) : default_value;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MQStandIn
+
+namespace MQStandIn
+{
+
+MQObject CreateGrid(int n, float size)
+{
+	MQObject obj = new MQCObject;
+	obj->Reserve((n + 1) * (n + 1),n * n,n * n * 4);
+	for(int j = 0; j <= n; j++)
+	for(int i = 0; i <= n; i++)
+	{
+		obj->AddVertex(MQPoint(-size * 0.5f + size * i / n,-size * 0.5f + size * j / n,0));
+	}
+	for(int j = 0; j < n; j++)
+	for(int i = 0; i < n; i++)
+	{
+		// clockwise seen from +z
+		int corners[4] = { j * (n + 1) + i, (j + 1) * (n + 1) + i, (j + 1) * (n + 1) + i + 1, j * (n + 1) + i + 1 };
+		obj->AddFace(4,corners);
+	}
+	return obj;
+}
+
+MQObject CreateSphere(int n, float radius)
+{
+	int rings = max(2,n / 2);
+	MQObject obj = new MQCObject;
+	obj->Reserve(n * (rings - 1) + 2,n * rings,n * rings * 4);
+
+	// poles first, then rings from the top
+	int top = obj->AddVertex(MQPoint(0,radius,0));
+	int bottom = obj->AddVertex(MQPoint(0,-radius,0));
+	for(int r = 1; r < rings; r++)
+	{
+		float phi = 3.14159265f * r / rings;
+		for(int s = 0; s < n; s++)
+		{
+			float theta = 2.0f * 3.14159265f * s / n;
+			obj->AddVertex(MQPoint(radius * sinf(phi) * cosf(theta),radius * cosf(phi),radius * sinf(phi) * sinf(theta)));
+		}
+	}
+	for(int s = 0; s < n; s++)
+	{
+		int s1 = (s + 1) % n;
+		int cap[3] = { top, 2 + s, 2 + s1 };
+		obj->AddFace(3,cap);
+		for(int r = 1; r + 1 < rings; r++)
+		{
+			int a = 2 + (r - 1) * n;
+			int b = 2 + r * n;
+			int quad[4] = { a + s, b + s, b + s1, a + s1 };
+			obj->AddFace(4,quad);
+		}
+		int a = 2 + (rings - 2) * n;
+		int cap2[3] = { bottom, a + s1, a + s };
+		obj->AddFace(3,cap2);
+	}
+	return obj;
+}
+
+static bool ends_with(const char* s, const char* suffix)
+{
+	size_t a = strlen(s), b = strlen(suffix);
+	if(a < b) return false;
+	for(size_t i = 0; i < b; i++) if(tolower(s[a - b + i]) != suffix[i]) return false;
+	return true;
+}
+
+// v and f lines. o starts another object. faces are counter-clockwise, so they are turned over
+static bool load_obj(MQDocument doc, FILE* fp)
+{
+	MQObject obj = NULL;
+	int base = 0;	// vertices of the file in objects before
+	int total = 0;
+	std::vector<int> corners;
+	char line[4096];
+	bool loaded = false;
+	while(fgets(line,sizeof(line),fp) != NULL)
+	{
+		if(line[0] == 'o' && line[1] == ' ')
+		{
+			if(obj != NULL && obj->GetVertexCount() > 0) { doc->AddObject(obj); loaded = true; obj = NULL; base = total; }
+		}
+		else if(line[0] == 'v' && line[1] == ' ')
+		{
+			if(obj == NULL) obj = new MQCObject;
+			float x = 0, y = 0, z = 0;
+			sscanf(line + 2,"%f %f %f",&x,&y,&z);
+			obj->AddVertex(MQPoint(x,y,z));
+			total++;
+		}
+		else if(line[0] == 'f' && line[1] == ' ')
+		{
+			if(obj == NULL) continue;
+			corners.clear();
+			char* p = line + 2;
+			while(*p)
+			{
+				while(*p == ' ' || *p == '\t') p++;
+				if(*p == '\0' || *p == '\n' || *p == '\r') break;
+				int index = (int)strtol(p,&p,10);
+				while(*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') p++;
+				int v = (index < 0) ? total + index : index - 1 - base;
+				if(v < 0 || v >= obj->GetVertexCount()) { corners.clear(); break; }
+				corners.push_back(v);
+			}
+			if(corners.size() < 3) continue;
+			std::reverse(corners.begin(),corners.end());
+			obj->AddFace((int)corners.size(),&corners[0]);
+		}
+	}
+	if(obj != NULL && obj->GetVertexCount() > 0) { doc->AddObject(obj); loaded = true; }
+	else delete obj;
+	return loaded;
+}
+
+// Object chunks with their vertex and face chunks, visible and locking. faces are clockwise already
+static bool load_mqo(MQDocument doc, FILE* fp)
+{
+	MQObject obj = NULL;
+	std::vector<int> corners;
+	char line[4096];
+	bool loaded = false;
+	while(fgets(line,sizeof(line),fp) != NULL)
+	{
+		char* p = line;
+		while(*p == ' ' || *p == '\t') p++;
+		if(strncmp(p,"Object ",7) == 0)
+		{
+			obj = new MQCObject;
+			doc->AddObject(obj);
+			loaded = true;
+		}
+		else if(obj == NULL) continue;
+		else if(strncmp(p,"visible ",8) == 0) obj->SetVisible(atoi(p + 8) != 0);
+		else if(strncmp(p,"locking ",8) == 0) obj->SetLocking(atoi(p + 8) != 0);
+		else if(strncmp(p,"vertex ",7) == 0)
+		{
+			int count = atoi(p + 7);
+			for(int i = 0; i < count && fgets(line,sizeof(line),fp) != NULL; i++)
+			{
+				float x = 0, y = 0, z = 0;
+				sscanf(line,"%f %f %f",&x,&y,&z);
+				obj->AddVertex(MQPoint(x,y,z));
+			}
+		}
+		else if(strncmp(p,"face ",5) == 0)
+		{
+			int count = atoi(p + 5);
+			for(int i = 0; i < count && fgets(line,sizeof(line),fp) != NULL; i++)
+			{
+				char* v = strstr(line,"V(");
+				if(v == NULL) continue;
+				v += 2;
+				corners.clear();
+				while(*v && *v != ')')
+				{
+					char* end;
+					int index = (int)strtol(v,&end,10);
+					if(end == v) break;
+					if(index >= 0 && index < obj->GetVertexCount()) corners.push_back(index);
+					v = end;
+				}
+				if(corners.size() >= 2) obj->AddFace((int)corners.size(),&corners[0]);
+			}
+		}
+	}
+	return loaded;
+}
+
+bool LoadMesh(MQDocument doc, const char* path)
+{
+	FILE* fp = fopen(path,"r");
+	if(fp == NULL) return false;
+	bool loaded = ends_with(path,".mqo") ? load_mqo(doc,fp) : load_obj(doc,fp);
+	fclose(fp);
+	return loaded;
+}
+
+void Translate(MQObject obj, const MQPoint& offset)
+{
+	for(int v = 0; v < obj->GetVertexCount(); v++) obj->SetVertex(v,obj->GetVertex(v) + offset);
+}
+
+void GetBounds(MQDocument doc, MQPoint& bmin, MQPoint& bmax)
+{
+	bool first = true;
+	bmin = bmax = MQPoint(0,0,0);
+	for(int o = 0; o < doc->GetObjectCount(); o++)
+	{
+		MQObject obj = doc->GetObject(o);
+		for(int v = 0; v < obj->GetVertexCount(); v++)
+		{
+			MQPoint p = obj->GetVertex(v);
+			if(first) { bmin = bmax = p; first = false; continue; }
+			bmin.x = min(bmin.x,p.x); bmin.y = min(bmin.y,p.y); bmin.z = min(bmin.z,p.z);
+			bmax.x = max(bmax.x,p.x); bmax.y = max(bmax.y,p.y); bmax.z = max(bmax.z,p.z);
+		}
+	}
+}
+
+void SetSetting(const char* section, const char* name, const char* value)
+{
+	s_settings[std::string(section) + "/" + name] = value;
+}
+
+MQCommandPlugin::EDIT_OPTION& GetEditOption() { return s_edit_option; }
+
+void SetProcessorCount(int count) { s_processors = count; }
+
+int GetHardwareProcessorCount()
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? (int)n : 1;
+}
+
+void SetVerbose(bool verbose) { s_verbose = verbose; }
+
+const DrawingStats& GetDrawingStats() { return s_drawing_stats; }
+
+void EndDraw()
+{
+	for(size_t i = 0; i < s_instant_objects.size(); i++) delete s_instant_objects[i];
+	s_instant_objects.clear();
+	for(size_t i = 0; i < s_instant_materials.size(); i++) delete s_instant_materials[i];
+	s_instant_materials.clear();
+	s_drawing_stats.instant_alive = 0;
+}
+
+void GetDrawingSummary(int& vertices, int& faces)
+{
+	vertices = faces = 0;
+	for(int pass = 0; pass < 2; pass++)
+	{
+		const std::vector<MQObject>& list = (pass == 0) ? s_instant_objects : s_drawing_objects;
+		for(size_t i = 0; i < list.size(); i++)
+		{
+			vertices += list[i]->GetVertexCount();
+			faces += list[i]->GetFaceCount();
+		}
+	}
+}
+
+}
@@ -0,0 +1,41 @@
+// What the benchmark uses to set up the stand-in SDK: meshes, settings and what the host would report
+#pragma once
+
+#include <windows.h>
+#include "MQBasePlugin.h"
+
+namespace MQStandIn
+{
+	// an n x n grid of quads in the xy plane, centered at the origin, facing +z
+	MQObject CreateGrid(int n, float size);
+	// n segments around and n / 2 from pole to pole, facing out
+	MQObject CreateSphere(int n, float radius);
+	// Wavefront .obj or Metasequoia .mqo. every object of the file is added to the document. false if nothing was read
+	bool LoadMesh(MQDocument doc, const char* path);
+
+	void Translate(MQObject obj, const MQPoint& offset);
+	void GetBounds(MQDocument doc, MQPoint& bmin, MQPoint& bmax);
+
+	// read by MQSetting, as if they were in Metasequoia.ini
+	void SetSetting(const char* section, const char* name, const char* value);
+	// returned by GetEditOption
+	MQCommandPlugin::EDIT_OPTION& GetEditOption();
+	// reported by GetSystemInfo. 0 for the processors of this machine
+	void SetProcessorCount(int count);
+	int GetHardwareProcessorCount();
+	// messages sent by the plugin through SendUserMessage go to stderr when set
+	void SetVerbose(bool verbose);
+
+	// drawing objects and materials made by the plugin so far
+	struct DrawingStats
+	{
+		long objects;
+		long materials;
+		long instant_alive;	// made for the current redraw
+	};
+	const DrawingStats& GetDrawingStats();
+	// drawing objects made for a redraw go away after it, as in Metasequoia
+	void EndDraw();
+	// vertices and faces of the drawing objects alive
+	void GetDrawingSummary(int& vertices, int& faces);
+}
@@ -0,0 +1,69 @@
+// Stand-in for the parts of <windows.h> ExMove.cpp uses, so that the plugin builds on Linux for the benchmark.
+// Threads, events and interlocked operations are implemented over pthreads in MQStandIn.cpp
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+typedef int BOOL;
+typedef unsigned long DWORD;
+typedef long LONG;
+typedef long long LONGLONG;
+typedef unsigned int UINT;
+typedef void* HANDLE;
+typedef void* LPVOID;
+
+typedef union
+{
+	struct { DWORD LowPart; LONG HighPart; };
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+struct POINT { LONG x, y; };
+
+#define TRUE 1
+#define FALSE 0
+#define APIENTRY
+#define WINAPI
+#define INFINITE 0xffffffff
+#define MAX_PATH 260
+#define _TRUNCATE ((size_t)-1)
+
+// windows.h has them as macros. templates keep <algorithm> working
+template<class A, class B> inline A min(A a, B b) { return a < b ? a : (A)b; }
+template<class A, class B> inline A max(A a, B b) { return a > b ? a : (A)b; }
+
+typedef struct { pthread_mutex_t mutex; } CRITICAL_SECTION;
+void InitializeCriticalSection(CRITICAL_SECTION* cs);
+void DeleteCriticalSection(CRITICAL_SECTION* cs);
+void EnterCriticalSection(CRITICAL_SECTION* cs);
+void LeaveCriticalSection(CRITICAL_SECTION* cs);
+
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(LPVOID);
+HANDLE CreateThread(void* attributes, size_t stack, LPTHREAD_START_ROUTINE start, LPVOID param, DWORD flags, DWORD* id);
+HANDLE CreateEvent(void* attributes, BOOL manual_reset, BOOL initial_state, const char* name);
+BOOL SetEvent(HANDLE event);
+BOOL ResetEvent(HANDLE event);
+DWORD WaitForSingleObject(HANDLE handle, DWORD ms);
+DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL all, DWORD ms);
+BOOL CloseHandle(HANDLE handle);
+
+LONG InterlockedIncrement(volatile LONG* p);
+LONG InterlockedDecrement(volatile LONG* p);
+LONG InterlockedExchange(volatile LONG* p, LONG value);
+LONG InterlockedExchangeAdd(volatile LONG* p, LONG value);
+LONG InterlockedCompareExchange(volatile LONG* p, LONG exchange, LONG comparand);
+
+typedef struct { DWORD dwNumberOfProcessors; } SYSTEM_INFO;
+void GetSystemInfo(SYSTEM_INFO* info);
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* freq);
+DWORD GetTickCount();
+void Sleep(DWORD ms);
+
+DWORD GetEnvironmentVariableA(const char* name, char* buffer, DWORD size);
+int fopen_s(FILE** fp, const char* path, const char* mode);
+int vsnprintf_s(char* buffer, size_t size, size_t count, const char* format, va_list args);